@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/shell/shell.h>
+
+#include "adv.h"
+#include "boot.h"
+#include "service.h"
+#include "stream.h"
+
+/* Fast interval while nobody is connected, slow one once a link may be
+ * streaming so advertising takes as little radio time as possible.
+ */
+enum adv_set {
+	ADV_SET_FAST,
+	ADV_SET_SLOW,
+	ADV_SET_NUM,
+	ADV_SET_NONE = ADV_SET_NUM,
+};
+
+#if defined(CONFIG_THROUGHPUT_EXT_ADV)
+
+#if defined(CONFIG_THROUGHPUT_ADV_PHY_CODED)
+#define ADV_OPT BT_LE_ADV_OPT_CODED
+#elif defined(CONFIG_THROUGHPUT_ADV_PHY_1M)
+#define ADV_OPT BT_LE_ADV_OPT_NO_2M
+#else
+#define ADV_OPT 0
+#endif
+
+#define ADV_OPTIONS (BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_EXT_ADV | ADV_OPT)
+#define ADV_FAST_INT_MIN BT_GAP_ADV_FAST_INT_MIN_1
+#define ADV_FAST_INT_MAX BT_GAP_ADV_FAST_INT_MAX_1
+
+/* Name and UUID fit in one AUX_ADV_IND, no scan request round needed */
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, SERVICE_UUID_BYTES),
+};
+
+#else
+
+#define ADV_OPTIONS (BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME)
+#define ADV_FAST_INT_MIN BT_GAP_ADV_FAST_INT_MIN_2
+#define ADV_FAST_INT_MAX BT_GAP_ADV_FAST_INT_MAX_2
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+};
+static const struct bt_data sd[] = {
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, SERVICE_UUID_BYTES),
+};
+
+#endif /* CONFIG_THROUGHPUT_EXT_ADV */
+
+static const struct bt_le_adv_param m_adv_param[ADV_SET_NUM] = {
+	[ADV_SET_FAST] = BT_LE_ADV_PARAM_INIT(ADV_OPTIONS,
+	                                      ADV_FAST_INT_MIN,
+	                                      ADV_FAST_INT_MAX,
+	                                      NULL),
+	[ADV_SET_SLOW] = BT_LE_ADV_PARAM_INIT(ADV_OPTIONS,
+	                                      BT_GAP_ADV_SLOW_INT_MIN,
+	                                      BT_GAP_ADV_SLOW_INT_MAX,
+	                                      NULL),
+};
+
+/* Back-off between attempts after the host refused to start or stop */
+#define RETRY_MIN_MS 100
+#define RETRY_MAX_MS 5000
+
+static void adv_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(adv_work, adv_work_handler);
+static uint32_t m_retry_ms = RETRY_MIN_MS;
+
+static atomic_t m_conn_cnt;
+static atomic_t m_adv_consumed;
+static enum adv_set m_active = ADV_SET_NONE;
+
+/* Connection setup is timed from boot, then from each disconnect */
+static int64_t m_wait_start;
+static bool m_waiting = true;
+
+/* Throughput while links are up, split by whether we were advertising */
+static struct {
+	int64_t ms;
+	uint64_t bytes;
+} m_impact[2];
+static int64_t m_mark_ms;
+static uint64_t m_mark_bytes;
+
+static void account(void)
+{
+	const int64_t now = k_uptime_get();
+	const uint64_t acked = stream_bytes_acked_total();
+
+	if (atomic_get(&m_conn_cnt) > 0) {
+		const bool advertising = m_active != ADV_SET_NONE;
+
+		m_impact[advertising].ms += now - m_mark_ms;
+		m_impact[advertising].bytes += acked - m_mark_bytes;
+	}
+	m_mark_ms = now;
+	m_mark_bytes = acked;
+}
+
+#if defined(CONFIG_THROUGHPUT_EXT_ADV)
+
+static struct bt_le_ext_adv *m_adv[ADV_SET_NUM];
+
+static int adv_set_start(enum adv_set set)
+{
+	int err;
+
+	if (!m_adv[set]) {
+		err = bt_le_ext_adv_create(&m_adv_param[set], NULL, &m_adv[set]);
+		if (err) {
+			printk("Failed to create advertising set (%d)\n", err);
+			return err;
+		}
+
+		err = bt_le_ext_adv_set_data(m_adv[set], ad, ARRAY_SIZE(ad),
+		                             NULL, 0);
+		if (err) {
+			printk("Failed to set advertising data (%d)\n", err);
+			return err;
+		}
+	}
+
+	return bt_le_ext_adv_start(m_adv[set], BT_LE_EXT_ADV_START_DEFAULT);
+}
+
+static int adv_set_stop(enum adv_set set)
+{
+	return bt_le_ext_adv_stop(m_adv[set]);
+}
+
+#else
+
+static int adv_set_start(enum adv_set set)
+{
+	return bt_le_adv_start(&m_adv_param[set], ad, ARRAY_SIZE(ad), sd,
+	                       ARRAY_SIZE(sd));
+}
+
+static int adv_set_stop(enum adv_set set)
+{
+	return bt_le_adv_stop();
+}
+
+#endif /* CONFIG_THROUGHPUT_EXT_ADV */
+
+// Nothing else triggers the work while no central is connected, so
+// failures have to be retried here
+static void adv_retry(void)
+{
+	k_work_schedule(&adv_work, K_MSEC(m_retry_ms));
+	m_retry_ms = MIN(m_retry_ms << 1, RETRY_MAX_MS);
+}
+
+static void adv_work_handler(struct k_work *work)
+{
+	const atomic_val_t conn_cnt = atomic_get(&m_conn_cnt);
+	enum adv_set want;
+	int err;
+
+	account();
+
+	/* Connectable advertising stops by itself when a central connects */
+	if (atomic_clear(&m_adv_consumed)) {
+		m_active = ADV_SET_NONE;
+	}
+
+	if (conn_cnt >= CONFIG_BT_MAX_CONN) {
+		want = ADV_SET_NONE;
+	} else if (conn_cnt > 0) {
+		want = ADV_SET_SLOW;
+	} else {
+		want = ADV_SET_FAST;
+	}
+
+	if (want == m_active) {
+		m_retry_ms = RETRY_MIN_MS;
+		return;
+	}
+
+	if (m_active != ADV_SET_NONE) {
+		err = adv_set_stop(m_active);
+		if (err) {
+			printk("Failed to stop advertiser (%d)\n", err);
+			adv_retry();
+			return;
+		}
+		m_active = ADV_SET_NONE;
+	}
+
+	if (want != ADV_SET_NONE) {
+		err = adv_set_start(want);
+		if (err) {
+			printk("Failed to start advertiser (%d), retrying in "
+			       "%u ms\n", err, m_retry_ms);
+			adv_retry();
+			return;
+		}
+		m_active = want;
+		boot_mark(BOOT_ADV_STARTED);
+	}
+	m_retry_ms = RETRY_MIN_MS;
+}
+
+void adv_start(void)
+{
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+
+void adv_connected(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	atomic_inc(&m_conn_cnt);
+	atomic_set(&m_adv_consumed, 1);
+	adv_start();
+
+	if (!m_waiting) {
+		return;
+	}
+
+	m_waiting = false;
+	printk("Connected %lld ms after %s\n", k_uptime_get() - m_wait_start,
+	       m_wait_start ? "disconnect" : "boot");
+
+	if (bt_conn_get_info(conn, &info) == 0) {
+		printk("Initial PHY: TX %u, RX %u\n",
+		       info.le.phy->tx_phy, info.le.phy->rx_phy);
+	}
+}
+
+void adv_disconnected(struct bt_conn *conn)
+{
+	atomic_dec(&m_conn_cnt);
+	if (!m_waiting) {
+		m_wait_start = k_uptime_get();
+		m_waiting = true;
+	}
+	adv_start();
+}
+
+static int cmd_adv(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char * const label[] = { "not advertising", "advertising" };
+
+	account();
+	shell_print(sh, "connections: %d, advertising set: %s",
+	            (int)atomic_get(&m_conn_cnt),
+	            m_active == ADV_SET_FAST ? "fast" :
+	            m_active == ADV_SET_SLOW ? "slow" : "none");
+
+	for (size_t i = 0; i < ARRAY_SIZE(m_impact); i++) {
+		const int64_t ms = m_impact[i].ms;
+
+		shell_print(sh, "%s: %lld ms, %llu bytes, %llu B/s", label[i],
+		            ms, m_impact[i].bytes,
+		            ms ? m_impact[i].bytes * 1000 / ms : 0);
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), adv, NULL,
+                 "Print advertising state and its throughput impact",
+                 cmd_adv, 1, 0);
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_ADV_H_
+#define THROUGHPUT_ADV_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * @brief Update connectable advertising.
+ *
+ * Advertises at a fast interval while nothing is connected, at a slow
+ * interval while some but not all connection slots are used and not at
+ * all once CONFIG_BT_MAX_CONN is reached. Uses legacy advertising with
+ * the service UUID in the scan response, or a single extended advertising
+ * PDU per set on the PHY selected in Kconfig when CONFIG_THROUGHPUT_EXT_ADV
+ * is enabled. The update runs on the system work queue.
+ */
+void adv_start(void);
+
+/**
+ * @brief Report a new connection to the advertiser.
+ *
+ * Prints the time from boot or from the previous disconnect until the
+ * connection was established.
+ *
+ * @param conn New connection.
+ */
+void adv_connected(struct bt_conn *conn);
+
+/**
+ * @brief Report a lost connection to the advertiser.
+ *
+ * @param conn Connection that went away.
+ */
+void adv_disconnected(struct bt_conn *conn);
+
+#endif /* THROUGHPUT_ADV_H_ */
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "boot.h"
+
+static const char * const event_name[BOOT_EVENT_COUNT] = {
+	[BOOT_BT_READY] = "bluetooth ready",
+	[BOOT_ADV_STARTED] = "advertising",
+	[BOOT_CONNECTED] = "connected",
+	[BOOT_FIRST_NOTIFY] = "first notification",
+	[BOOT_SETTINGS_LOADED] = "settings loaded",
+};
+
+/* Uptime in ms, 0 while the milestone has not been reached */
+static int64_t m_boot_ms[BOOT_EVENT_COUNT];
+
+void boot_mark(enum boot_event event)
+{
+	if (m_boot_ms[event]) {
+		return;
+	}
+
+	/* Uptime starts with the kernel, which is within a few ms of reset */
+	m_boot_ms[event] = MAX(k_uptime_get(), 1);
+	printk("Boot: %s after %lld ms\n", event_name[event], m_boot_ms[event]);
+}
+
+static int cmd_boot(const struct shell *sh, size_t argc, char **argv)
+{
+	for (size_t i = 0; i < BOOT_EVENT_COUNT; i++) {
+		if (m_boot_ms[i]) {
+			shell_print(sh, "%-20s %lld ms", event_name[i], m_boot_ms[i]);
+		} else {
+			shell_print(sh, "%-20s -", event_name[i]);
+		}
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), boot, NULL,
+                 "Print time from reset to boot milestones", cmd_boot, 1, 0);
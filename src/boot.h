@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_BOOT_H_
+#define THROUGHPUT_BOOT_H_
+
+/** @brief Boot milestones, timed from reset. */
+enum boot_event {
+	BOOT_BT_READY,
+	BOOT_ADV_STARTED,
+	BOOT_CONNECTED,
+	BOOT_FIRST_NOTIFY,
+	BOOT_SETTINGS_LOADED,
+	BOOT_EVENT_COUNT,
+};
+
+/**
+ * @brief Record a boot milestone.
+ *
+ * Only the first occurrence of each event after reset is kept, later
+ * calls are cheap no-ops so this can sit on the hot path.
+ *
+ * @param event Milestone reached.
+ */
+void boot_mark(enum boot_event event);
+
+#endif /* THROUGHPUT_BOOT_H_ */
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+#if defined(CONFIG_THROUGHPUT_CHAN_QOS_REPORT)
+#include <sdc_hci_vs.h>
+#endif
+
+#include "chan_mon.h"
+#include "matrix.h"
+#include "stream.h"
+
+#define PERIOD_MS CONFIG_THROUGHPUT_CHAN_MON_PERIOD_MS
+/* Packets a channel needs before the hint judges it */
+#define HINT_MIN_PACKETS 32
+/* The hint covers the last one to two windows */
+#define HINT_WINDOW_MS 10000
+
+/* Link layer counters of one data channel, all connections */
+struct chan_stats {
+	uint32_t events;
+	uint32_t tx;
+	uint32_t tx_acked;
+	uint32_t rx;
+	uint32_t rx_crc_err;
+};
+
+struct chan_mon {
+	struct bt_conn *conn;
+	uint16_t handle;
+	struct k_work_delayable work;
+	int8_t rssi;
+	int8_t rssi_min;
+	int8_t rssi_max;
+	uint8_t map[5];
+	uint32_t map_changes;
+	uint64_t last_acked;
+	uint32_t goodput;       /* Bytes/s over the last period */
+	uint32_t events;
+	struct chan_mon_packets pkts;
+};
+
+static struct chan_mon m_mon[CONFIG_BT_MAX_CONN];
+static struct chan_stats m_chan[CHAN_MON_DATA_CHANNELS];
+/* Counters at the start of the previous and the current hint window */
+static struct chan_stats m_chan_prev[CHAN_MON_DATA_CHANNELS];
+static struct chan_stats m_chan_start[CHAN_MON_DATA_CHANNELS];
+static bool m_qos_enabled;
+
+static uint8_t map_used(const uint8_t map[5])
+{
+	uint8_t used = 0;
+
+	for (size_t i = 0; i < 5; i++) {
+		used += __builtin_popcount(map[i]);
+	}
+
+	return used;
+}
+
+static int read_rssi(uint16_t handle, int8_t *rssi)
+{
+	struct bt_hci_cp_read_rssi *cp;
+	struct bt_hci_rp_read_rssi *rp;
+	struct net_buf *buf, *rsp = NULL;
+	int err;
+
+	buf = bt_hci_cmd_create(BT_HCI_OP_READ_RSSI, sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(handle);
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_RSSI, buf, &rsp);
+	if (err) {
+		return err;
+	}
+	rp = (void *)rsp->data;
+	*rssi = rp->rssi;
+	net_buf_unref(rsp);
+
+	return 0;
+}
+
+static int read_chan_map(uint16_t handle, uint8_t map[5])
+{
+	struct bt_hci_cp_le_read_chan_map *cp;
+	struct bt_hci_rp_le_read_chan_map *rp;
+	struct net_buf *buf, *rsp = NULL;
+	int err;
+
+	buf = bt_hci_cmd_create(BT_HCI_OP_LE_READ_CHAN_MAP, sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(handle);
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_LE_READ_CHAN_MAP, buf, &rsp);
+	if (err) {
+		return err;
+	}
+	rp = (void *)rsp->data;
+	memcpy(map, rp->ch_map, 5);
+	net_buf_unref(rsp);
+
+	return 0;
+}
+
+static void sample_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct chan_mon *mon = CONTAINER_OF(dwork, struct chan_mon, work);
+	struct stream_stats stats;
+	uint8_t map[5];
+	int8_t rssi;
+
+	if (!mon->conn) {
+		return;
+	}
+
+	stream_stats_get(mon->conn, &stats);
+	mon->goodput = (stats.bytes_acked - mon->last_acked) * 1000 / PERIOD_MS;
+	mon->last_acked = stats.bytes_acked;
+
+	if (read_rssi(mon->handle, &rssi) == 0) {
+		mon->rssi = rssi;
+		mon->rssi_min = MIN(mon->rssi_min, rssi);
+		mon->rssi_max = MAX(mon->rssi_max, rssi);
+	}
+
+	if (read_chan_map(mon->handle, map) == 0 &&
+	    memcmp(map, mon->map, sizeof(map))) {
+		// Logged with the current goodput to correlate dips with the
+		// central's channel blacklisting
+		if (map_used(mon->map)) {
+			mon->map_changes++;
+			printk("Channel map changed: %u -> %u channels, "
+			       "%u B/s, RSSI %d\n", map_used(mon->map),
+			       map_used(map), mon->goodput, mon->rssi);
+		}
+		memcpy(mon->map, map, sizeof(map));
+	}
+
+	k_work_schedule(&mon->work, K_MSEC(PERIOD_MS));
+}
+
+#if defined(CONFIG_THROUGHPUT_CHAN_QOS_REPORT)
+
+static void window_work_handler(struct k_work *work)
+{
+	memcpy(m_chan_prev, m_chan_start, sizeof(m_chan_prev));
+	memcpy(m_chan_start, m_chan, sizeof(m_chan_start));
+	k_work_reschedule(k_work_delayable_from_work(work),
+	                  K_MSEC(HINT_WINDOW_MS));
+}
+
+static K_WORK_DELAYABLE_DEFINE(m_window_work, window_work_handler);
+
+static struct chan_mon *mon_of_handle(uint16_t handle)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_mon); i++) {
+		if (m_mon[i].conn && m_mon[i].handle == handle) {
+			return &m_mon[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Runs in the host RX context for every connection event, keep it short */
+static bool vs_evt_cb(struct net_buf_simple *buf)
+{
+	const sdc_hci_subevent_vs_qos_conn_event_report_t *evt;
+	struct chan_stats *chan;
+	struct chan_mon *mon;
+
+	if (buf->len < 1 + sizeof(*evt) ||
+	    net_buf_simple_pull_u8(buf) !=
+	    SDC_HCI_SUBEVENT_VS_QOS_CONN_EVENT_REPORT) {
+		return false;
+	}
+
+	evt = net_buf_simple_pull_mem(buf, sizeof(*evt));
+	if (evt->channel_index >= CHAN_MON_DATA_CHANNELS) {
+		return true;
+	}
+
+	chan = &m_chan[evt->channel_index];
+	chan->events++;
+	chan->tx += evt->tx_packet_count;
+	chan->tx_acked += evt->tx_ack_count;
+	chan->rx += evt->rx_packet_count;
+	chan->rx_crc_err += evt->rx_crc_error_count;
+
+	mon = mon_of_handle(sys_le16_to_cpu(evt->conn_handle));
+	if (mon) {
+		mon->events++;
+		mon->pkts.tx += evt->tx_packet_count;
+		mon->pkts.tx_acked += evt->tx_ack_count;
+		mon->pkts.rx += evt->rx_packet_count;
+		mon->pkts.rx_crc_err += evt->rx_crc_error_count;
+		matrix_link_packets(mon->conn, evt->tx_packet_count,
+		                    evt->tx_packet_count - evt->tx_ack_count);
+	}
+
+	return true;
+}
+
+void chan_mon_init(void)
+{
+	sdc_hci_cmd_vs_qos_conn_event_report_enable_t *cp;
+	struct net_buf *buf;
+	int err;
+
+	err = bt_hci_register_vnd_evt_cb(vs_evt_cb);
+	if (err) {
+		printk("Failed to register vendor event callback (%d)\n", err);
+		return;
+	}
+
+	buf = bt_hci_cmd_create(SDC_HCI_OPCODE_CMD_VS_QOS_CONN_EVENT_REPORT_ENABLE,
+	                        sizeof(*cp));
+	if (!buf) {
+		return;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->enable = 1;
+
+	err = bt_hci_cmd_send_sync(SDC_HCI_OPCODE_CMD_VS_QOS_CONN_EVENT_REPORT_ENABLE,
+	                           buf, NULL);
+	if (err) {
+		printk("Failed to enable QoS connection event reports (%d)\n",
+		       err);
+		return;
+	}
+	m_qos_enabled = true;
+	k_work_reschedule(&m_window_work, K_MSEC(HINT_WINDOW_MS));
+}
+
+#else
+
+void chan_mon_init(void)
+{
+	/* Only RSSI and the channel map, no per-event counters */
+}
+
+#endif /* CONFIG_THROUGHPUT_CHAN_QOS_REPORT */
+
+void chan_mon_connected(struct bt_conn *conn)
+{
+	struct chan_mon *mon = &m_mon[bt_conn_index(conn)];
+	uint16_t handle;
+
+	/* Counters start at zero even when this link is not monitored */
+	memset(&mon->pkts, 0, sizeof(mon->pkts));
+	if (PERIOD_MS == 0 || bt_hci_get_conn_handle(conn, &handle)) {
+		return;
+	}
+
+	memset(mon, 0, sizeof(*mon));
+	k_work_init_delayable(&mon->work, sample_work_handler);
+	mon->rssi_min = INT8_MAX;
+	mon->rssi_max = INT8_MIN;
+	mon->handle = handle;
+	mon->conn = bt_conn_ref(conn);
+	k_work_schedule(&mon->work, K_MSEC(PERIOD_MS));
+}
+
+void chan_mon_disconnected(struct bt_conn *conn)
+{
+	struct chan_mon *mon = &m_mon[bt_conn_index(conn)];
+
+	if (mon->conn != conn) {
+		return;
+	}
+	mon->conn = NULL;
+	k_work_cancel_delayable(&mon->work);
+	bt_conn_unref(conn);
+}
+
+bool chan_mon_reports_enabled(void)
+{
+	return m_qos_enabled;
+}
+
+int chan_mon_packets_get(const struct bt_conn *conn,
+                         struct chan_mon_packets *pkts)
+{
+	if (!m_qos_enabled) {
+		return -ENOTSUP;
+	}
+
+	/* Kept after disconnection until the index is reused */
+	*pkts = m_mon[bt_conn_index(conn)].pkts;
+	return 0;
+}
+
+uint8_t chan_mon_hint(uint8_t map[5])
+{
+	memset(map, 0, 5);
+
+	for (uint8_t ch = 0; ch < CHAN_MON_DATA_CHANNELS; ch++) {
+		// Recent counts only, so channels that recovered come back
+		const struct chan_stats *s = &m_chan[ch];
+		const struct chan_stats *p = &m_chan_prev[ch];
+		const uint32_t tx = s->tx - p->tx;
+		const uint32_t packets = tx + s->rx - p->rx;
+		const uint32_t errors = tx - (s->tx_acked - p->tx_acked) +
+		                        s->rx_crc_err - p->rx_crc_err;
+
+		if (packets < HINT_MIN_PACKETS ||
+		    errors * 100 <= packets * CONFIG_THROUGHPUT_CHAN_BAD_PER) {
+			map[ch / 8] |= BIT(ch % 8);
+		}
+	}
+
+	return map_used(map);
+}
+
+static int cmd_channels(const struct shell *sh, size_t argc, char **argv)
+{
+	uint8_t hint[5];
+	uint8_t used;
+
+	for (size_t i = 0; i < ARRAY_SIZE(m_mon); i++) {
+		const struct chan_mon *mon = &m_mon[i];
+
+		shell_print(sh, "conn %u%s", i, mon->conn ? "" : " (down)");
+		shell_print(sh, "  rssi:        %d (min %d, max %d)",
+		            mon->rssi, mon->rssi_min, mon->rssi_max);
+		shell_print(sh, "  channel map: %02x%02x%02x%02x%02x "
+		            "(%u channels, %u changes)",
+		            mon->map[4], mon->map[3], mon->map[2], mon->map[1],
+		            mon->map[0], map_used(mon->map), mon->map_changes);
+		shell_print(sh, "  goodput:     %u B/s", mon->goodput);
+		if (m_qos_enabled) {
+			shell_print(sh, "  events:      %u, retransmits %u, "
+			            "rx crc errors %u", mon->events,
+			            mon->pkts.tx - mon->pkts.tx_acked,
+			            mon->pkts.rx_crc_err);
+		}
+	}
+
+	if (!m_qos_enabled) {
+		shell_print(sh, "Per-channel counters need the SoftDevice "
+		            "Controller and CONFIG_THROUGHPUT_CHAN_QOS_REPORT");
+		return 0;
+	}
+
+	shell_print(sh, "ch,events,tx,tx_acked,rx,rx_crc_err");
+	for (uint8_t ch = 0; ch < CHAN_MON_DATA_CHANNELS; ch++) {
+		const struct chan_stats *s = &m_chan[ch];
+
+		shell_print(sh, "%u,%u,%u,%u,%u,%u", ch, s->events, s->tx,
+		            s->tx_acked, s->rx, s->rx_crc_err);
+	}
+
+	used = chan_mon_hint(hint);
+	shell_print(sh, "Suggested channel map from the last %u-%u s: "
+	            "%02x%02x%02x%02x%02x (%u channels)",
+	            HINT_WINDOW_MS / 1000, 2 * HINT_WINDOW_MS / 1000, hint[4],
+	            hint[3], hint[2], hint[1], hint[0], used);
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		memset(m_chan, 0, sizeof(m_chan));
+		memset(m_chan_prev, 0, sizeof(m_chan_prev));
+		memset(m_chan_start, 0, sizeof(m_chan_start));
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), channels, NULL,
+                 "Print RSSI, channel map and per-channel link quality "
+                 "[reset]", cmd_channels, 1, 1);
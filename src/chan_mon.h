@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_CHAN_MON_H_
+#define THROUGHPUT_CHAN_MON_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/** @brief Number of data channels. */
+#define CHAN_MON_DATA_CHANNELS 37
+
+/** @brief Link layer packet counters of one connection. */
+struct chan_mon_packets {
+	uint32_t tx;          /**< Packets transmitted. */
+	uint32_t tx_acked;    /**< Transmitted packets the peer acknowledged. */
+	uint32_t rx;          /**< Packets received. */
+	uint32_t rx_crc_err;  /**< Received packets with a CRC error. */
+};
+
+/**
+ * @brief Enable controller connection event reports if configured.
+ *
+ * Call once Bluetooth is enabled.
+ */
+void chan_mon_init(void);
+
+/**
+ * @brief Start sampling RSSI and the channel map of a connection.
+ *
+ * @param conn New connection.
+ */
+void chan_mon_connected(struct bt_conn *conn);
+
+/**
+ * @brief Stop sampling a connection.
+ *
+ * @param conn Connection that went away.
+ */
+void chan_mon_disconnected(struct bt_conn *conn);
+
+/**
+ * @brief Check whether connection event reports are being collected.
+ *
+ * @return True once the controller sends connection event reports.
+ */
+bool chan_mon_reports_enabled(void);
+
+/**
+ * @brief Get the packet counters of a connection since it was created.
+ *
+ * @param conn Connection.
+ * @param pkts Counters.
+ *
+ * @return 0 on success, -ENOTSUP without connection event reports.
+ */
+int chan_mon_packets_get(const struct bt_conn *conn,
+                         struct chan_mon_packets *pkts);
+
+/**
+ * @brief Suggest a channel map from the packet error rate of each channel.
+ *
+ * Channels whose error rate over the last 10 to 20 seconds exceeds
+ * CONFIG_THROUGHPUT_CHAN_BAD_PER are cleared. Channels without enough
+ * samples in that time are kept.
+ *
+ * @param map Channel map in HCI order, bit n is data channel n.
+ *
+ * @return Number of channels in the suggested map.
+ */
+uint8_t chan_mon_hint(uint8_t map[5]);
+
+#endif /* THROUGHPUT_CHAN_MON_H_ */
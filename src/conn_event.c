@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+#include <sdc_hci_vs.h>
+#define EVENT_LEN_DEFAULT_US CONFIG_BT_CTLR_SDC_MAX_CONN_EVENT_LEN_DEFAULT
+#else
+#define EVENT_LEN_DEFAULT_US 0
+#endif
+
+#include "conn_event.h"
+#include "stream.h"
+
+/* Distinct configurations throughput is recorded for */
+#define CONFIGS_MAX 8
+
+struct event_cfg {
+	uint32_t len_us;
+	bool extend;
+};
+
+static void cfg_work_handler(struct k_work *work);
+static K_WORK_DEFINE(cfg_work, cfg_work_handler);
+
+static struct k_spinlock m_lock;
+static struct event_cfg m_wanted = {
+	.len_us = EVENT_LEN_DEFAULT_US,
+	.extend = IS_ENABLED(CONFIG_THROUGHPUT_CONN_EVENT_EXTEND),
+};
+static struct event_cfg m_applied;
+
+/* Throughput measured under each configuration, summed over connections */
+struct event_result {
+	struct event_cfg cfg;
+	int64_t ms;
+	uint64_t bytes;
+};
+
+static struct event_result m_results[CONFIGS_MAX];
+static size_t m_result_cnt;
+
+/* The controller applies an event length to connections created after it
+ * was set, so each connection keeps the one it was created with.
+ * Extension applies to all connections at once.
+ */
+static struct {
+	uint32_t len_us;
+	int64_t since_ms;
+	uint64_t since_bytes;
+} m_conn[CONFIG_BT_MAX_CONN];
+
+static void account(struct bt_conn *conn)
+{
+	const uint8_t idx = bt_conn_index(conn);
+	const int64_t now = k_uptime_get();
+	struct stream_stats stats;
+	struct event_cfg cfg;
+	k_spinlock_key_t key;
+	size_t i;
+
+	stream_stats_get(conn, &stats);
+
+	key = k_spin_lock(&m_lock);
+	cfg.len_us = m_conn[idx].len_us;
+	cfg.extend = m_applied.extend;
+	for (i = 0; i < m_result_cnt; i++) {
+		if (m_results[i].cfg.len_us == cfg.len_us &&
+		    m_results[i].cfg.extend == cfg.extend) {
+			break;
+		}
+	}
+	if (i == m_result_cnt && m_result_cnt < CONFIGS_MAX) {
+		m_results[m_result_cnt++].cfg = cfg;
+	}
+	if (i < m_result_cnt) {
+		m_results[i].ms += now - m_conn[idx].since_ms;
+		m_results[i].bytes += stats.bytes_acked -
+		                      m_conn[idx].since_bytes;
+	}
+	m_conn[idx].since_ms = now;
+	m_conn[idx].since_bytes = stats.bytes_acked;
+	k_spin_unlock(&m_lock, key);
+}
+
+static void account_cb(struct bt_conn *conn, void *data)
+{
+	account(conn);
+}
+
+void conn_event_connected(struct bt_conn *conn)
+{
+	const uint8_t idx = bt_conn_index(conn);
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	m_conn[idx].len_us = m_applied.len_us;
+	m_conn[idx].since_ms = k_uptime_get();
+	m_conn[idx].since_bytes = 0;
+	k_spin_unlock(&m_lock, key);
+}
+
+void conn_event_disconnected(struct bt_conn *conn)
+{
+	account(conn);
+}
+
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+
+static int event_len_send(uint32_t us)
+{
+	sdc_hci_cmd_vs_event_length_set_t *cp;
+	struct net_buf *buf;
+
+	buf = bt_hci_cmd_create(SDC_HCI_OPCODE_CMD_VS_EVENT_LENGTH_SET,
+	                        sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->event_length_us = sys_cpu_to_le32(us);
+
+	return bt_hci_cmd_send_sync(SDC_HCI_OPCODE_CMD_VS_EVENT_LENGTH_SET,
+	                            buf, NULL);
+}
+
+static int event_extend_send(bool enable)
+{
+	sdc_hci_cmd_vs_conn_event_extend_t *cp;
+	struct net_buf *buf;
+
+	buf = bt_hci_cmd_create(SDC_HCI_OPCODE_CMD_VS_CONN_EVENT_EXTEND,
+	                        sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->enable = enable;
+
+	return bt_hci_cmd_send_sync(SDC_HCI_OPCODE_CMD_VS_CONN_EVENT_EXTEND,
+	                            buf, NULL);
+}
+
+// HCI commands block until the controller answers, so they are sent from
+// the system work queue rather than the Bluetooth callbacks that ask.
+static void cfg_work_handler(struct k_work *work)
+{
+	struct event_cfg wanted;
+	k_spinlock_key_t key;
+	int err;
+
+	key = k_spin_lock(&m_lock);
+	wanted = m_wanted;
+	k_spin_unlock(&m_lock, key);
+
+	if (wanted.len_us != m_applied.len_us) {
+		err = event_len_send(wanted.len_us);
+		if (err) {
+			printk("Failed to set event length (%d)\n", err);
+		} else {
+			key = k_spin_lock(&m_lock);
+			m_applied.len_us = wanted.len_us;
+			k_spin_unlock(&m_lock, key);
+		}
+	}
+
+	if (wanted.extend != m_applied.extend) {
+		/* Close the running stints under the old setting */
+		bt_conn_foreach(BT_CONN_TYPE_LE, account_cb, NULL);
+		err = event_extend_send(wanted.extend);
+		if (err) {
+			printk("Failed to set event extension (%d)\n", err);
+		} else {
+			key = k_spin_lock(&m_lock);
+			m_applied.extend = wanted.extend;
+			k_spin_unlock(&m_lock, key);
+		}
+	}
+
+	printk("Connection event length %u us, extension %s\n",
+	       m_applied.len_us, m_applied.extend ? "on" : "off");
+}
+
+void conn_event_init(void)
+{
+	/* Force both commands so the controller state is known */
+	m_applied.len_us = UINT32_MAX;
+	m_applied.extend = !m_wanted.extend;
+	k_work_submit(&cfg_work);
+}
+
+#else
+
+static void cfg_work_handler(struct k_work *work)
+{
+}
+
+void conn_event_init(void)
+{
+}
+
+#endif /* CONFIG_BT_LL_SOFTDEVICE */
+
+int conn_event_len_set(uint32_t us)
+{
+	k_spinlock_key_t key;
+
+	if (!IS_ENABLED(CONFIG_BT_LL_SOFTDEVICE)) {
+		return -ENOTSUP;
+	}
+
+	key = k_spin_lock(&m_lock);
+	m_wanted.len_us = us;
+	k_spin_unlock(&m_lock, key);
+	k_work_submit(&cfg_work);
+
+	return 0;
+}
+
+int conn_event_extend_set(bool enable)
+{
+	k_spinlock_key_t key;
+
+	if (!IS_ENABLED(CONFIG_BT_LL_SOFTDEVICE)) {
+		return -ENOTSUP;
+	}
+
+	key = k_spin_lock(&m_lock);
+	m_wanted.extend = enable;
+	k_spin_unlock(&m_lock, key);
+	k_work_submit(&cfg_work);
+
+	return 0;
+}
+
+static int cmd_event(const struct shell *sh, size_t argc, char **argv)
+{
+	struct event_result results[CONFIGS_MAX];
+	k_spinlock_key_t key;
+	size_t cnt;
+	int err = 0;
+
+	if (argc == 3 && strcmp(argv[1], "len") == 0) {
+		err = conn_event_len_set(strtoul(argv[2], NULL, 0));
+		if (!err) {
+			shell_print(sh, "Applies to connections made from now "
+			            "on, existing ones keep their length");
+		}
+	} else if (argc == 3 && strcmp(argv[1], "ext") == 0) {
+		err = conn_event_extend_set(strcmp(argv[2], "on") == 0);
+	} else if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+		bt_conn_foreach(BT_CONN_TYPE_LE, account_cb, NULL);
+		key = k_spin_lock(&m_lock);
+		memset(m_results, 0, sizeof(m_results));
+		m_result_cnt = 0;
+		k_spin_unlock(&m_lock, key);
+	} else if (argc > 1) {
+		shell_help(sh);
+		return -EINVAL;
+	}
+	if (err) {
+		shell_error(sh, "Not supported by this controller (%d)", err);
+		return err;
+	}
+	if (argc > 1) {
+		return 0;
+	}
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, account_cb, NULL);
+	shell_print(sh, "event_len_us,extend,link_ms,bytes,goodput_Bps");
+	key = k_spin_lock(&m_lock);
+	cnt = m_result_cnt;
+	memcpy(results, m_results, sizeof(results));
+	k_spin_unlock(&m_lock, key);
+	for (size_t i = 0; i < cnt; i++) {
+		const int64_t ms = results[i].ms;
+
+		shell_print(sh, "%u,%u,%lld,%llu,%llu",
+		            results[i].cfg.len_us, results[i].cfg.extend,
+		            ms, results[i].bytes,
+		            ms ? results[i].bytes * 1000 / ms : 0);
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), event, NULL,
+                 "Set connection event length [len <us>] or extension "
+                 "[ext on|off], or print throughput per configuration "
+                 "[reset]", cmd_event, 1, 2);
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_CONN_EVENT_H_
+#define THROUGHPUT_CONN_EVENT_H_
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * @brief Apply the default connection event configuration.
+ *
+ * Call once Bluetooth is enabled.
+ */
+void conn_event_init(void);
+
+/**
+ * @brief Note the event length a new connection was created with.
+ *
+ * @param conn New connection.
+ */
+void conn_event_connected(struct bt_conn *conn);
+
+/**
+ * @brief Account the throughput of a connection that went away.
+ *
+ * @param conn Connection that went away.
+ */
+void conn_event_disconnected(struct bt_conn *conn);
+
+/**
+ * @brief Set the controller's connection event length.
+ *
+ * The controller applies the length to connections created after the
+ * command, existing ones keep theirs. The command is sent from the
+ * system work queue, so this is safe to call from Bluetooth callbacks.
+ *
+ * @param us Event length in microseconds.
+ *
+ * @return 0 if queued, -ENOTSUP without the SoftDevice Controller.
+ */
+int conn_event_len_set(uint32_t us);
+
+/**
+ * @brief Enable or disable connection event extension.
+ *
+ * An extended event keeps going past its length while there is data and
+ * the radio is free, so a busy link can use the time an idle one leaves.
+ *
+ * @param enable True to let connection events extend.
+ *
+ * @return 0 if queued, -ENOTSUP without the SoftDevice Controller.
+ */
+int conn_event_extend_set(bool enable);
+
+#endif /* THROUGHPUT_CONN_EVENT_H_ */
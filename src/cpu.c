@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "stream.h"
+
+/* Totals at the previous "throughput cpu", for per-window figures */
+static uint64_t m_mark_cycles;
+static uint64_t m_mark_busy;
+static uint64_t m_mark_bytes;
+static int64_t m_mark_ms;
+
+struct thread_ctx {
+	const struct shell *sh;
+	uint64_t total;
+};
+
+static void thread_cb(const struct k_thread *thread, void *user_data)
+{
+	const struct thread_ctx *ctx = user_data;
+	k_thread_runtime_stats_t stats;
+	const char *name;
+
+	if (k_thread_runtime_stats_get((k_tid_t)thread, &stats) ||
+	    !ctx->total) {
+		return;
+	}
+
+	name = k_thread_name_get((k_tid_t)thread);
+	shell_print(ctx->sh, "  %-20s %3u.%u %%", name ? name : "?",
+	            (uint32_t)(stats.execution_cycles * 100 / ctx->total),
+	            (uint32_t)(stats.execution_cycles * 1000 / ctx->total % 10));
+}
+
+static int cmd_cpu(const struct shell *sh, size_t argc, char **argv)
+{
+	k_thread_runtime_stats_t all;
+	const int64_t now = k_uptime_get();
+	const uint64_t acked = stream_bytes_acked_total();
+	uint64_t cycles, busy;
+	struct thread_ctx ctx = { .sh = sh };
+
+	if (k_thread_runtime_stats_all_get(&all)) {
+		shell_error(sh, "Thread runtime statistics are not enabled");
+		return -ENOTSUP;
+	}
+
+	/* execution_cycles includes the idle thread, total_cycles does not */
+	cycles = all.execution_cycles - m_mark_cycles;
+	busy = all.total_cycles - m_mark_busy;
+	if (cycles && now > m_mark_ms) {
+		shell_print(sh, "Last %lld ms: headroom %u %%, %llu B/s",
+		            now - m_mark_ms,
+		            (uint32_t)(100 - busy * 100 / cycles),
+		            (acked - m_mark_bytes) * 1000 / (now - m_mark_ms));
+	}
+
+	shell_print(sh, "Share of CPU since boot:");
+	ctx.total = all.execution_cycles;
+	k_thread_foreach(thread_cb, &ctx);
+
+	m_mark_cycles = all.execution_cycles;
+	m_mark_busy = all.total_cycles;
+	m_mark_bytes = acked;
+	m_mark_ms = now;
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), cpu, NULL,
+                 "Print CPU headroom and throughput since the last call, "
+                 "and CPU share per thread", cmd_cpu, 1, 0);
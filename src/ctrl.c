@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+#include "ctrl.h"
+#include "hist.h"
+
+#define CTRL_QUEUE_LEN 8
+
+struct ctrl_msg {
+	struct bt_conn *conn;   /* Reference held while queued */
+	uint8_t len;
+	uint8_t data[CTRL_DATA_MAX];
+	uint32_t queued_us;
+};
+
+K_MSGQ_DEFINE(ctrl_msgq, sizeof(struct ctrl_msg), CTRL_QUEUE_LEN, 4);
+
+static const struct bt_gatt_attr *m_attr;
+static struct k_sem *m_wake;
+
+/* From ctrl_send() to TX completion, all connections */
+static struct log2_hist m_latency_us;
+static uint32_t m_latency_max_us;
+static uint32_t m_dropped;
+static uint32_t m_failed;
+
+static uint32_t now_us(void)
+{
+	return k_cyc_to_us_floor64(k_cycle_get_64());
+}
+
+static void sent_cb(struct bt_conn *conn, void *user_data)
+{
+	const uint32_t latency_us = now_us() - POINTER_TO_UINT(user_data);
+
+	hist_add(&m_latency_us, latency_us);
+	m_latency_max_us = MAX(m_latency_max_us, latency_us);
+}
+
+void ctrl_init(const struct bt_gatt_attr *attr, struct k_sem *wake)
+{
+	m_attr = attr;
+	m_wake = wake;
+}
+
+int ctrl_send(struct bt_conn *conn, const void *data, uint8_t len)
+{
+	struct ctrl_msg msg = {
+		.len = len,
+		.queued_us = now_us(),
+	};
+
+	if (len > CTRL_DATA_MAX) {
+		return -EINVAL;
+	}
+	memcpy(msg.data, data, len);
+
+	msg.conn = bt_conn_ref(conn);
+	if (k_msgq_put(&ctrl_msgq, &msg, K_NO_WAIT)) {
+		bt_conn_unref(conn);
+		m_dropped++;
+		return -ENOMEM;
+	}
+	if (m_wake) {
+		k_sem_give(m_wake);
+	}
+
+	return 0;
+}
+
+void ctrl_flush(void)
+{
+	struct ctrl_msg msg;
+
+	while (m_attr && k_msgq_get(&ctrl_msgq, &msg, K_NO_WAIT) == 0) {
+		struct bt_gatt_notify_params params = {
+			.attr = m_attr,
+			.data = msg.data,
+			.len = msg.len,
+			.func = sent_cb,
+			.user_data = UINT_TO_POINTER(msg.queued_us),
+		};
+
+		if (bt_gatt_notify_cb(msg.conn, &params)) {
+			m_failed++;
+		}
+		bt_conn_unref(msg.conn);
+	}
+}
+
+static int cmd_control(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "control notifications: %u, dropped %u, failed %u",
+	            m_latency_us.count, m_dropped, m_failed);
+	shell_print(sh, "latency p50 %u us, p90 %u us, p99 %u us, max %u us",
+	            hist_percentile(&m_latency_us, 50),
+	            hist_percentile(&m_latency_us, 90),
+	            hist_percentile(&m_latency_us, 99), m_latency_max_us);
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		memset(&m_latency_us, 0, sizeof(m_latency_us));
+		m_latency_max_us = 0;
+		m_dropped = 0;
+		m_failed = 0;
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), control, NULL,
+                 "Print control notification latency [reset]",
+                 cmd_control, 1, 1);
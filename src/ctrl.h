@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_CTRL_H_
+#define THROUGHPUT_CTRL_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+/** @brief Largest control notification payload. */
+#define CTRL_DATA_MAX 8
+
+/**
+ * @brief Set up the control lane.
+ *
+ * @param attr Control characteristic, notified with the responses.
+ * @param wake Given when a response is queued, so an idle sender wakes.
+ */
+void ctrl_init(const struct bt_gatt_attr *attr, struct k_sem *wake);
+
+/**
+ * @brief Queue a control notification.
+ *
+ * Control notifications overtake bulk data at the next buffer boundary
+ * and use TX buffers that bulk streaming leaves free, see
+ * CONFIG_THROUGHPUT_CTRL_CREDITS.
+ *
+ * @param conn Connection to notify.
+ * @param data Payload.
+ * @param len  Payload length, up to CTRL_DATA_MAX.
+ *
+ * @return 0 if queued, -EINVAL if too long, -ENOMEM if the queue is full.
+ */
+int ctrl_send(struct bt_conn *conn, const void *data, uint8_t len);
+
+/**
+ * @brief Send all queued control notifications.
+ *
+ * Call from the notify thread between bulk buffers.
+ */
+void ctrl_flush(void);
+
+#endif /* THROUGHPUT_CTRL_H_ */
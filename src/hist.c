@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+
+#include "hist.h"
+
+void hist_add(struct log2_hist *hist, uint32_t value)
+{
+	/* Bit length of value: 0 -> 0, 1 -> 1, 2..3 -> 2, ... */
+	const uint8_t idx = value ? 32 - __builtin_clz(value) : 0;
+
+	hist->bucket[MIN(idx, HIST_BUCKETS - 1)]++;
+	hist->count++;
+}
+
+uint32_t hist_bucket_max(uint8_t idx)
+{
+	return idx ? BIT(idx) - 1 : 0;
+}
+
+uint32_t hist_percentile(const struct log2_hist *hist, uint8_t pct)
+{
+	const uint32_t rank = DIV_ROUND_UP((uint64_t)hist->count * pct, 100);
+	uint32_t seen = 0;
+
+	for (uint8_t i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= rank && seen) {
+			return hist_bucket_max(i);
+		}
+	}
+
+	return 0;
+}
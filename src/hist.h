@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_HIST_H_
+#define THROUGHPUT_HIST_H_
+
+#include <zephyr/types.h>
+
+/* Bucket i counts values in [2^(i-1), 2^i), bucket 0 counts zero */
+#define HIST_BUCKETS 25
+
+/** @brief Histogram with power-of-two buckets. */
+struct log2_hist {
+	uint32_t bucket[HIST_BUCKETS];
+	uint32_t count;
+};
+
+/**
+ * @brief Add a sample.
+ *
+ * @param hist  Histogram.
+ * @param value Sample, values past the last bucket are clamped into it.
+ */
+void hist_add(struct log2_hist *hist, uint32_t value);
+
+/**
+ * @brief Estimate a percentile.
+ *
+ * @param hist Histogram.
+ * @param pct  Percentile, 0 to 100.
+ *
+ * @return Upper bound of the bucket holding the percentile, 0 when empty.
+ */
+uint32_t hist_percentile(const struct log2_hist *hist, uint8_t pct);
+
+/**
+ * @brief Upper bound of a bucket.
+ *
+ * @param idx Bucket index.
+ *
+ * @return Largest value counted in bucket @p idx.
+ */
+uint32_t hist_bucket_max(uint8_t idx);
+
+#endif /* THROUGHPUT_HIST_H_ */
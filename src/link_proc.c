@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+#include "link_proc.h"
+
+#define PROC_TIMEOUT_MS CONFIG_THROUGHPUT_LINK_PROC_TIMEOUT_MS
+#define PROC_ATTEMPTS   (CONFIG_THROUGHPUT_LINK_PROC_RETRIES + 1)
+/* Delay before retrying a request the host rejected right away */
+#define PROC_BACKOFF_MS 50
+
+#define PROC_NONE LINK_PROC_COUNT
+
+/* Parameters of each procedure type */
+struct link_proc_params {
+	struct bt_conn_le_phy_param phy;
+	struct bt_conn_le_data_len_param data_len;
+	struct bt_le_conn_param conn_param;
+};
+
+struct link_proc {
+	struct bt_conn *conn;
+	struct k_work_delayable work;
+	uint8_t pending;           /* Bitmask of enum link_proc_type */
+	enum link_proc_type active;
+	uint8_t attempts;
+	int64_t started;
+	struct link_proc_params cur;    /* Of the active procedure */
+	struct link_proc_params queued; /* Of the pending procedures */
+	struct link_proc_stats stats[LINK_PROC_COUNT];
+};
+
+static struct k_spinlock m_lock;
+static struct link_proc m_proc[CONFIG_BT_MAX_CONN];
+
+static const char * const proc_name[LINK_PROC_COUNT] = {
+	[LINK_PROC_PHY] = "phy",
+	[LINK_PROC_DATA_LEN] = "data len",
+	[LINK_PROC_CONN_PARAM] = "conn param",
+};
+
+static struct link_proc *proc_of(const struct bt_conn *conn)
+{
+	return &m_proc[bt_conn_index(conn)];
+}
+
+static void *params_of(struct link_proc_params *params,
+                       enum link_proc_type type, size_t *len)
+{
+	switch (type) {
+	case LINK_PROC_PHY:
+		*len = sizeof(params->phy);
+		return &params->phy;
+	case LINK_PROC_DATA_LEN:
+		*len = sizeof(params->data_len);
+		return &params->data_len;
+	default:
+		*len = sizeof(params->conn_param);
+		return &params->conn_param;
+	}
+}
+
+// Procedures the peer rejects or that change nothing produce no event, and
+// failed or peer initiated ones produce one all the same, so the current
+// link state decides whether we got what we asked.
+static bool satisfied(struct link_proc *proc, enum link_proc_type type)
+{
+	struct bt_conn_info info;
+
+	if (bt_conn_get_info(proc->conn, &info)) {
+		return false;
+	}
+
+	switch (type) {
+	case LINK_PROC_PHY:
+		return (info.le.phy->tx_phy & proc->cur.phy.pref_tx_phy) &&
+		       (info.le.phy->rx_phy & proc->cur.phy.pref_rx_phy);
+	case LINK_PROC_DATA_LEN:
+		return info.le.data_len->tx_max_len >=
+		       proc->cur.data_len.tx_max_len;
+	case LINK_PROC_CONN_PARAM:
+		return info.le.interval >= proc->cur.conn_param.interval_min &&
+		       info.le.interval <= proc->cur.conn_param.interval_max;
+	default:
+		return true;
+	}
+}
+
+static int issue(struct link_proc *proc, enum link_proc_type type)
+{
+	switch (type) {
+	case LINK_PROC_PHY:
+		return bt_conn_le_phy_update(proc->conn, &proc->cur.phy);
+	case LINK_PROC_DATA_LEN:
+		return bt_conn_le_data_len_update(proc->conn,
+		                                  &proc->cur.data_len);
+	case LINK_PROC_CONN_PARAM:
+		return bt_conn_le_param_update(proc->conn,
+		                               &proc->cur.conn_param);
+	default:
+		return -EINVAL;
+	}
+}
+
+static void finish(struct link_proc *proc)
+{
+	struct link_proc_stats *stats = &proc->stats[proc->active];
+	const int64_t now = k_uptime_get();
+	const uint32_t ms = now - proc->started;
+
+	stats->completed++;
+	stats->last_ms = ms;
+	stats->min_ms = stats->completed == 1 ? ms : MIN(stats->min_ms, ms);
+	stats->max_ms = MAX(stats->max_ms, ms);
+	stats->done_at = now;
+	proc->active = PROC_NONE;
+}
+
+static void proc_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct link_proc *proc = CONTAINER_OF(dwork, struct link_proc, work);
+	enum link_proc_type type = PROC_NONE;
+	k_spinlock_key_t key;
+	int err;
+
+	key = k_spin_lock(&m_lock);
+	if (!proc->conn) {
+		k_spin_unlock(&m_lock, key);
+		return;
+	}
+
+	if (proc->active != PROC_NONE) {
+		/* Timed out, or the host rejected the request */
+		if (satisfied(proc, proc->active)) {
+			finish(proc);
+		} else if (proc->attempts < PROC_ATTEMPTS) {
+			/* Most likely an LL procedure collision, try again */
+			proc->stats[proc->active].retries++;
+			type = proc->active;
+		} else {
+			printk("Giving up %s update\n", proc_name[proc->active]);
+			proc->stats[proc->active].failed++;
+			proc->active = PROC_NONE;
+		}
+	}
+
+	if (proc->active == PROC_NONE && proc->pending) {
+		size_t len;
+		void *cur;
+
+		type = find_lsb_set(proc->pending) - 1;
+		cur = params_of(&proc->cur, type, &len);
+		memcpy(cur, params_of(&proc->queued, type, &len), len);
+		proc->pending &= ~BIT(type);
+		proc->active = type;
+		proc->attempts = 0;
+		proc->started = k_uptime_get();
+	}
+
+	if (type != PROC_NONE) {
+		proc->attempts++;
+	}
+	k_spin_unlock(&m_lock, key);
+
+	if (type == PROC_NONE) {
+		return;
+	}
+
+	err = issue(proc, type);
+	if (err) {
+		printk("Requesting %s update failed (err %d)\n",
+		       proc_name[type], err);
+	}
+	k_work_reschedule(&proc->work,
+	                  K_MSEC(err ? PROC_BACKOFF_MS : PROC_TIMEOUT_MS));
+}
+
+static void request(struct bt_conn *conn, enum link_proc_type type,
+                    const void *param)
+{
+	struct link_proc *proc = proc_of(conn);
+	k_spinlock_key_t key;
+	size_t len;
+	const void *cur = params_of(&proc->cur, type, &len);
+	void *queued = params_of(&proc->queued, type, &len);
+
+	key = k_spin_lock(&m_lock);
+	if (!proc->conn) {
+		k_spin_unlock(&m_lock, key);
+		return;
+	}
+
+	if (proc->active == type && !memcmp(cur, param, len)) {
+		/* Same procedure already running, drop a queued other one */
+		proc->stats[type].coalesced++;
+		proc->pending &= ~BIT(type);
+	} else {
+		if (proc->pending & BIT(type)) {
+			/* Replaces the queued one */
+			proc->stats[type].coalesced++;
+		}
+		/* The running procedure keeps its own target */
+		memcpy(queued, param, len);
+		proc->pending |= BIT(type);
+	}
+	k_spin_unlock(&m_lock, key);
+
+	k_work_schedule(&proc->work, K_NO_WAIT);
+}
+
+void link_proc_phy(struct bt_conn *conn,
+                   const struct bt_conn_le_phy_param *param)
+{
+	request(conn, LINK_PROC_PHY, param);
+}
+
+void link_proc_data_len(struct bt_conn *conn,
+                        const struct bt_conn_le_data_len_param *param)
+{
+	request(conn, LINK_PROC_DATA_LEN, param);
+}
+
+void link_proc_conn_param(struct bt_conn *conn,
+                          const struct bt_le_conn_param *param)
+{
+	request(conn, LINK_PROC_CONN_PARAM, param);
+}
+
+void link_proc_done(struct bt_conn *conn, enum link_proc_type type)
+{
+	struct link_proc *proc = proc_of(conn);
+	k_spinlock_key_t key;
+	bool ours, done = false;
+
+	key = k_spin_lock(&m_lock);
+	/* Peer initiated procedures of other types are not ours to finish */
+	ours = proc->conn && proc->active == type;
+	/* Also reported when the procedure failed, e.g. on an LL collision,
+	 * or when the peer ran one of its own
+	 */
+	if (ours && satisfied(proc, type)) {
+		finish(proc);
+		done = true;
+	}
+	k_spin_unlock(&m_lock, key);
+
+	if (done) {
+		k_work_reschedule(&proc->work, K_NO_WAIT);
+	} else if (ours) {
+		/* The work handler retries it */
+		k_work_reschedule(&proc->work, K_MSEC(PROC_BACKOFF_MS));
+	}
+}
+
+void link_proc_connected(struct bt_conn *conn)
+{
+	struct link_proc *proc = proc_of(conn);
+
+	k_work_init_delayable(&proc->work, proc_work_handler);
+	memset(proc->stats, 0, sizeof(proc->stats));
+	proc->pending = 0;
+	proc->active = PROC_NONE;
+	proc->conn = bt_conn_ref(conn);
+}
+
+void link_proc_disconnected(struct bt_conn *conn)
+{
+	struct link_proc *proc = proc_of(conn);
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&m_lock);
+	if (proc->conn != conn) {
+		k_spin_unlock(&m_lock, key);
+		return;
+	}
+	proc->conn = NULL;
+	proc->pending = 0;
+	proc->active = PROC_NONE;
+	k_spin_unlock(&m_lock, key);
+
+	k_work_cancel_delayable(&proc->work);
+	bt_conn_unref(conn);
+}
+
+bool link_proc_idle(const struct bt_conn *conn)
+{
+	const struct link_proc *proc = proc_of(conn);
+	k_spinlock_key_t key;
+	bool idle;
+
+	key = k_spin_lock(&m_lock);
+	idle = proc->active == PROC_NONE && !proc->pending;
+	k_spin_unlock(&m_lock, key);
+
+	return idle;
+}
+
+void link_proc_stats_get(const struct bt_conn *conn, enum link_proc_type type,
+                         struct link_proc_stats *stats)
+{
+	*stats = proc_of(conn)->stats[type];
+}
+
+static int cmd_link_proc(const struct shell *sh, size_t argc, char **argv)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_proc); i++) {
+		shell_print(sh, "conn %u", i);
+		for (size_t t = 0; t < LINK_PROC_COUNT; t++) {
+			const struct link_proc_stats *s = &m_proc[i].stats[t];
+
+			shell_print(sh, "  %-10s done %u (last %u ms, min %u, "
+			            "max %u) coalesced %u retries %u failed %u",
+			            proc_name[t], s->completed, s->last_ms,
+			            s->min_ms, s->max_ms, s->coalesced,
+			            s->retries, s->failed);
+		}
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), linkproc, NULL,
+                 "Print link procedure negotiation times", cmd_link_proc,
+                 1, 0);
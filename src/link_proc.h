@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_LINK_PROC_H_
+#define THROUGHPUT_LINK_PROC_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/** @brief Link layer procedures driven by the application. */
+enum link_proc_type {
+	LINK_PROC_PHY,
+	LINK_PROC_DATA_LEN,
+	LINK_PROC_CONN_PARAM,
+	LINK_PROC_COUNT,
+};
+
+/** @brief Negotiation statistics of one procedure type. */
+struct link_proc_stats {
+	uint32_t completed;
+	uint32_t coalesced;  /* Requests merged into a pending one */
+	uint32_t retries;
+	uint32_t failed;     /* Given up after all retries */
+	uint32_t last_ms;
+	uint32_t min_ms;
+	uint32_t max_ms;
+	int64_t done_at;     /* Uptime of the last completion */
+};
+
+/**
+ * @brief Start tracking procedures on a new connection.
+ *
+ * @param conn New connection.
+ */
+void link_proc_connected(struct bt_conn *conn);
+
+/**
+ * @brief Drop all pending procedures of a connection.
+ *
+ * @param conn Connection that went away.
+ */
+void link_proc_disconnected(struct bt_conn *conn);
+
+/**
+ * @brief Queue a PHY update.
+ *
+ * Procedures run one at a time per connection. A request replaces any
+ * not yet started request of the same type.
+ *
+ * @param conn  Connection.
+ * @param param Preferred PHYs.
+ */
+void link_proc_phy(struct bt_conn *conn,
+		   const struct bt_conn_le_phy_param *param);
+
+/**
+ * @brief Queue a data length update.
+ *
+ * @param conn  Connection.
+ * @param param Preferred TX data length and time.
+ */
+void link_proc_data_len(struct bt_conn *conn,
+			const struct bt_conn_le_data_len_param *param);
+
+/**
+ * @brief Queue a connection parameter update.
+ *
+ * @param conn  Connection.
+ * @param param Preferred connection parameters.
+ */
+void link_proc_conn_param(struct bt_conn *conn,
+			  const struct bt_le_conn_param *param);
+
+/**
+ * @brief Report completion of a procedure from the connection callbacks.
+ *
+ * The callbacks also run for failed and peer initiated procedures, so the
+ * active procedure only counts as completed if the link now has what it
+ * asked for, otherwise it is retried.
+ *
+ * @param conn Connection.
+ * @param type Procedure that completed.
+ */
+void link_proc_done(struct bt_conn *conn, enum link_proc_type type);
+
+/**
+ * @brief Check whether all requested procedures have finished.
+ *
+ * @param conn Connection.
+ *
+ * @return true if no procedure is running or queued.
+ */
+bool link_proc_idle(const struct bt_conn *conn);
+
+/**
+ * @brief Get the negotiation statistics of a connection.
+ *
+ * @param conn  Connection.
+ * @param type  Procedure type.
+ * @param stats Destination.
+ */
+void link_proc_stats_get(const struct bt_conn *conn, enum link_proc_type type,
+			 struct link_proc_stats *stats);
+
+#endif /* THROUGHPUT_LINK_PROC_H_ */
@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hist.h"
+#include "load.h"
+
+#define CPU_THREADS_MAX CONFIG_THROUGHPUT_LOAD_THREADS
+#define CPU_STACK_SIZE  512
+/* Busy and idle time of a CPU load thread add up to this period */
+#define CPU_PERIOD_MS   10
+/* Cooperative threads are never preempted, so they must leave idle time
+ * for the Bluetooth host and the shell that stops them.
+ */
+#define CPU_COOP_DUTY_MAX 90
+#define FLASH_DATA_MAX  64
+/* NVS writes and garbage collection run on their own queue, so they do
+ * not hold up the Bluetooth host's work on the system work queue.
+ */
+#define FLASH_STACK_SIZE 1024
+#define FLASH_PRIORITY   K_PRIO_PREEMPT(CONFIG_NUM_PREEMPT_PRIORITIES - 1)
+/* Load settings throughput and latency are recorded for */
+#define RESULTS_MAX     8
+
+struct load_cfg {
+	uint8_t cpu_threads;
+	int8_t cpu_prio;
+	uint8_t cpu_duty;      /* Percent of CPU_PERIOD_MS spent busy */
+	uint32_t irq_period_us;
+	uint32_t irq_busy_us;
+	uint32_t flash_period_ms;
+	uint16_t flash_bytes;
+};
+
+static struct load_cfg m_cfg;
+
+/* Notifications completed while one load setting was active */
+struct load_result {
+	struct load_cfg cfg;
+	int64_t first_ms;
+	int64_t last_ms;
+	uint64_t bytes;
+	struct log2_hist latency_us;
+};
+
+static struct k_spinlock m_lock;
+static struct load_result m_results[RESULTS_MAX];
+static size_t m_result_cnt;
+
+static K_THREAD_STACK_ARRAY_DEFINE(m_cpu_stacks, CPU_THREADS_MAX,
+                                   CPU_STACK_SIZE);
+static struct k_thread m_cpu_threads[CPU_THREADS_MAX];
+static bool m_cpu_created;
+
+static void irq_timer_handler(struct k_timer *timer);
+static K_TIMER_DEFINE(m_irq_timer, irq_timer_handler, NULL);
+
+static K_THREAD_STACK_DEFINE(m_flash_stack, FLASH_STACK_SIZE);
+static struct k_work_q m_flash_q;
+
+static void flash_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_flash_work, flash_work_handler);
+
+static void cpu_thread(void *p1, void *p2, void *p3)
+{
+	const uintptr_t idx = (uintptr_t)p1;
+
+	while (1) {
+		const uint32_t busy_ms = CPU_PERIOD_MS * m_cfg.cpu_duty / 100;
+
+		if (idx >= m_cfg.cpu_threads || busy_ms == 0) {
+			k_msleep(100);
+			continue;
+		}
+
+		k_busy_wait(busy_ms * USEC_PER_MSEC);
+		if (busy_ms < CPU_PERIOD_MS) {
+			k_msleep(CPU_PERIOD_MS - busy_ms);
+		}
+	}
+}
+
+static void irq_timer_handler(struct k_timer *timer)
+{
+	/* Stands in for interrupt handlers doing real work */
+	k_busy_wait(m_cfg.irq_busy_us);
+}
+
+// Settings writes go through NVS, which also garbage collects and erases
+// pages now and then, like a product storing data in the background.
+static void flash_work_handler(struct k_work *work)
+{
+	static uint8_t data[FLASH_DATA_MAX];
+	int err;
+
+	if (!m_cfg.flash_period_ms) {
+		return;
+	}
+
+	data[0]++;
+	err = settings_save_one("throughput/load", data, m_cfg.flash_bytes);
+	if (err) {
+		printk("Load flash write failed (%d)\n", err);
+	}
+	k_work_schedule_for_queue(&m_flash_q, &m_flash_work,
+	                          K_MSEC(m_cfg.flash_period_ms));
+}
+
+// Refuse new settings once every row is taken, rather than recording
+// them under an older row's label
+static int results_check(const struct shell *sh)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+	const bool full = m_result_cnt == RESULTS_MAX;
+
+	k_spin_unlock(&m_lock, key);
+	if (full) {
+		shell_error(sh, "All %u result rows are used, print them and "
+		            "run \"throughput load reset\"", RESULTS_MAX);
+		return -ENOSPC;
+	}
+
+	return 0;
+}
+
+// Start a new results row for the settings just applied, see
+// results_check()
+static void results_next(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	if (m_result_cnt < RESULTS_MAX) {
+		memset(&m_results[m_result_cnt], 0, sizeof(m_results[0]));
+		m_results[m_result_cnt].cfg = m_cfg;
+		m_result_cnt++;
+	}
+	k_spin_unlock(&m_lock, key);
+}
+
+void load_record(uint16_t len, uint32_t latency_us)
+{
+	const int64_t now = k_uptime_get();
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	if (m_result_cnt) {
+		struct load_result *res = &m_results[m_result_cnt - 1];
+
+		if (!res->first_ms) {
+			res->first_ms = now;
+		} else {
+			res->bytes += len;
+		}
+		res->last_ms = now;
+		hist_add(&res->latency_us, latency_us);
+	}
+	k_spin_unlock(&m_lock, key);
+}
+
+static void cpu_apply(void)
+{
+	for (uintptr_t i = 0; i < CPU_THREADS_MAX; i++) {
+		if (!m_cpu_created) {
+			char name[16];
+
+			k_thread_create(&m_cpu_threads[i], m_cpu_stacks[i],
+			                K_THREAD_STACK_SIZEOF(m_cpu_stacks[i]),
+			                cpu_thread, (void *)i, NULL, NULL,
+			                m_cfg.cpu_prio, 0, K_NO_WAIT);
+			snprintk(name, sizeof(name), "load %u", (unsigned int)i);
+			k_thread_name_set(&m_cpu_threads[i], name);
+		} else {
+			k_thread_priority_set(&m_cpu_threads[i], m_cfg.cpu_prio);
+		}
+	}
+	m_cpu_created = true;
+}
+
+static int cmd_load_cpu(const struct shell *sh, size_t argc, char **argv)
+{
+	const unsigned long threads = strtoul(argv[1], NULL, 0);
+	const long prio = argc > 2 ? strtol(argv[2], NULL, 0) : 10;
+	const unsigned long duty = argc > 3 ? strtoul(argv[3], NULL, 0) : 50;
+
+	if (threads > CPU_THREADS_MAX || duty > 100 ||
+	    prio < -CONFIG_NUM_COOP_PRIORITIES ||
+	    prio >= CONFIG_NUM_PREEMPT_PRIORITIES) {
+		shell_error(sh, "Up to %u threads, priority %d..%d, duty 0..100",
+		            CPU_THREADS_MAX, -CONFIG_NUM_COOP_PRIORITIES,
+		            CONFIG_NUM_PREEMPT_PRIORITIES - 1);
+		return -EINVAL;
+	}
+	if (prio < 0 && duty > CPU_COOP_DUTY_MAX) {
+		shell_error(sh, "Cooperative threads run at most %u %% duty",
+		            CPU_COOP_DUTY_MAX);
+		return -EINVAL;
+	}
+	if (results_check(sh)) {
+		return -ENOSPC;
+	}
+
+	m_cfg.cpu_threads = threads;
+	m_cfg.cpu_prio = prio;
+	m_cfg.cpu_duty = duty;
+	if (threads) {
+		cpu_apply();
+	}
+	results_next();
+
+	return 0;
+}
+
+static int cmd_load_irq(const struct shell *sh, size_t argc, char **argv)
+{
+	const unsigned long period_us = strtoul(argv[1], NULL, 0);
+	const unsigned long busy_us = argc > 2 ? strtoul(argv[2], NULL, 0) : 10;
+
+	if (period_us && busy_us >= period_us) {
+		shell_error(sh, "Busy time must be shorter than the period");
+		return -EINVAL;
+	}
+	if (results_check(sh)) {
+		return -ENOSPC;
+	}
+
+	m_cfg.irq_period_us = period_us;
+	m_cfg.irq_busy_us = busy_us;
+	if (period_us) {
+		k_timer_start(&m_irq_timer, K_USEC(period_us), K_USEC(period_us));
+	} else {
+		k_timer_stop(&m_irq_timer);
+	}
+	results_next();
+
+	return 0;
+}
+
+static int cmd_load_flash(const struct shell *sh, size_t argc, char **argv)
+{
+	const unsigned long period_ms = strtoul(argv[1], NULL, 0);
+	const unsigned long bytes = argc > 2 ? strtoul(argv[2], NULL, 0) : 32;
+
+	if (!IS_ENABLED(CONFIG_SETTINGS)) {
+		shell_error(sh, "Flash load needs CONFIG_SETTINGS");
+		return -ENOTSUP;
+	}
+	if (bytes == 0 || bytes > FLASH_DATA_MAX) {
+		shell_error(sh, "Write 1..%u bytes", FLASH_DATA_MAX);
+		return -EINVAL;
+	}
+	if (results_check(sh)) {
+		return -ENOSPC;
+	}
+
+	m_cfg.flash_period_ms = period_ms;
+	m_cfg.flash_bytes = bytes;
+	if (period_ms) {
+		k_work_reschedule_for_queue(&m_flash_q, &m_flash_work,
+		                            K_NO_WAIT);
+	} else {
+		k_work_cancel_delayable(&m_flash_work);
+	}
+	results_next();
+
+	return 0;
+}
+
+static int cmd_load(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+		m_result_cnt = 0;
+		k_spin_unlock(&m_lock, key);
+		results_next();
+		return 0;
+	}
+
+	shell_print(sh, "cpu_threads,cpu_prio,cpu_duty,irq_period_us,"
+	            "irq_busy_us,flash_period_ms,flash_bytes,ms,goodput_Bps,"
+	            "lat_p50_us,lat_p90_us,lat_p99_us");
+
+	for (size_t i = 0; i < RESULTS_MAX; i++) {
+		/* Completions keep updating the last row while printing */
+		k_spinlock_key_t key = k_spin_lock(&m_lock);
+		const bool used = i < m_result_cnt;
+		struct load_result res;
+
+		if (used) {
+			res = m_results[i];
+		}
+		k_spin_unlock(&m_lock, key);
+		if (!used) {
+			break;
+		}
+
+		const int64_t ms = res.last_ms - res.first_ms;
+
+		shell_print(sh, "%u,%d,%u,%u,%u,%u,%u,%lld,%llu,%u,%u,%u",
+		            res.cfg.cpu_threads, res.cfg.cpu_prio,
+		            res.cfg.cpu_duty, res.cfg.irq_period_us,
+		            res.cfg.irq_busy_us, res.cfg.flash_period_ms,
+		            res.cfg.flash_bytes, ms,
+		            ms ? res.bytes * 1000 / ms : 0,
+		            hist_percentile(&res.latency_us, 50),
+		            hist_percentile(&res.latency_us, 90),
+		            hist_percentile(&res.latency_us, 99));
+	}
+
+	return 0;
+}
+
+/* Row for the unloaded baseline */
+static int load_init(void)
+{
+	static const struct k_work_queue_config flash_q_cfg = {
+		.name = "load flash",
+	};
+
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		k_work_queue_start(&m_flash_q, m_flash_stack,
+		                   K_THREAD_STACK_SIZEOF(m_flash_stack),
+		                   FLASH_PRIORITY, &flash_q_cfg);
+	}
+	results_next();
+
+	return 0;
+}
+
+SYS_INIT(load_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(load_cmds,
+	SHELL_CMD_ARG(cpu, NULL,
+	              "<threads> [priority] [duty %]: CPU burning threads, "
+	              "0 threads to stop, cooperative ones at most 90 %",
+	              cmd_load_cpu, 2, 2),
+	SHELL_CMD_ARG(irq, NULL,
+	              "<period us> [busy us]: timer interrupt storm, "
+	              "period 0 to stop", cmd_load_irq, 2, 1),
+	SHELL_CMD_ARG(flash, NULL,
+	              "<period ms> [bytes]: periodic settings writes from "
+	              "a low priority work queue, period 0 to stop",
+	              cmd_load_flash, 2, 1),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_SUBCMD_ADD((throughput), load, &load_cmds,
+                 "Generate background load, or print throughput and "
+                 "latency per load setting [reset]", cmd_load, 1, 1);
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_LOAD_H_
+#define THROUGHPUT_LOAD_H_
+
+#include <zephyr/types.h>
+
+/**
+ * @brief Record a completed notification against the current load.
+ *
+ * @param len        Payload bytes.
+ * @param latency_us Time from notify call to TX completion.
+ */
+void load_record(uint16_t len, uint32_t latency_us);
+
+#endif /* THROUGHPUT_LOAD_H_ */
@@ -5,7 +5,9 @@
  */
 
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
 #include <zephyr/sys/printk.h>
+#include <zephyr/sys/atomic.h>
 #include <string.h>
 #include <stdlib.h>
 #include <zephyr/types.h>
@@ -16,30 +18,28 @@
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/hci.h>
 #include <zephyr/bluetooth/uuid.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/shell/shell_uart.h>
 
 
 #include "main.h"
-
-#define DEVICE_NAME	CONFIG_BT_DEVICE_NAME
-#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
-#define MTU_OVERHEAD 3
-
-typedef enum {
-	SET_PREFERRED_PHY = 0,
-} workqueue_tasktype_t; 
-
-typedef struct workqueue_item {
-	workqueue_tasktype_t tasktype;
-	union
-	{
-		struct preferred_phy_opts {
-			uint8_t rx_phytype;
-			uint8_t tx_phytype;
-		} pref_phy_opts;
-	};
-} workqueue_item_t;
-K_MSGQ_DEFINE(work_msgq, sizeof(workqueue_item_t), 2, 4);
+#include "adv.h"
+#include "boot.h"
+#include "chan_mon.h"
+#include "conn_event.h"
+#include "ctrl.h"
+#include "link_proc.h"
+#include "matrix.h"
+#include "payload.h"
+#include "profile.h"
+#include "selfcheck.h"
+#include "service.h"
+#include "steady.h"
+#include "stream.h"
+#include "telemetry.h"
+#include "transport.h"
+#include "watchdog.h"
 
 static ssize_t write_cmd_cb(struct bt_conn *conn,
                             const struct bt_gatt_attr *attr,
@@ -49,24 +49,31 @@ static ssize_t write_cmd_cb(struct bt_conn *conn,
                             uint8_t flags);
 static void notif_ccc_cb(const struct bt_gatt_attr *attr, uint16_t value);
 
-static volatile bool data_length_req;
-static volatile bool test_ready;
-static volatile bool m_notif_enabled = false;
-static volatile bool m_notif_send    = false;
-static volatile uint16_t m_mtu = 23;
-static struct bt_conn *default_conn;
+// Per-connection streaming state, indexed by bt_conn_index()
+struct link {
+	struct bt_conn *conn;
+	volatile bool notif_send;
+	volatile uint16_t mtu;
+	struct payload *msg;    // Being sent, owned by the notify thread
+	uint32_t msg_idx_cnt;
+	uint16_t msg_offset;
+	uint16_t payload_cap;   // 0 when not limited
+#if defined(CONFIG_THROUGHPUT_PRODUCER_THREAD)
+	struct k_fifo ready;    // Produced, not yet sent
+	atomic_t queued;
+#endif
+};
 
-static uint8_t  m_msg_buffer[CONFIG_BT_L2CAP_TX_MTU - MTU_OVERHEAD];
-static uint32_t m_msg_idx_cnt = 0;
+static struct link m_links[CONFIG_BT_MAX_CONN];
 
-#define SERVICE_UUID_BYTES 0xf4, 0xec, 0x36, 0x41, 0xde, 0x4b, 0x45, 0xa7, \
-                           0xf8, 0x4a, 0xbd, 0x54, 0x64, 0xe4, 0xb3, 0x1f
 static struct bt_uuid_128 service_uuid = BT_UUID_INIT_128(SERVICE_UUID_BYTES);
 static struct bt_uuid_16  cmd_uuid     = BT_UUID_INIT_16(0x1000);
 static struct bt_uuid_16  notif_uuid   = BT_UUID_INIT_16(0x1001);
+static struct bt_uuid_16  ctrl_uuid    = BT_UUID_INIT_16(0x1002);
 
 
-struct bt_gatt_attr m_attrs[] = {
+// Static so the attribute table is in place before bt_enable() completes
+BT_GATT_SERVICE_DEFINE(m_svc,
     BT_GATT_PRIMARY_SERVICE(&service_uuid),
     BT_GATT_CHARACTERISTIC((const struct bt_uuid *)&cmd_uuid,
                            BT_GATT_CHRC_WRITE_WITHOUT_RESP,
@@ -81,15 +88,14 @@ struct bt_gatt_attr m_attrs[] = {
                            NULL,
                            NULL),
     BT_GATT_CCC(notif_ccc_cb, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
-};
-static struct bt_gatt_service m_svcs = BT_GATT_SERVICE(m_attrs);
-static const struct bt_data ad[] = {
-	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
-	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
-};
-static const struct bt_data sd[] = {
-	BT_DATA_BYTES(BT_DATA_UUID128_ALL, SERVICE_UUID_BYTES),
-};
+    BT_GATT_CHARACTERISTIC((const struct bt_uuid *)&ctrl_uuid,
+                           BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_NONE,
+                           NULL,
+                           NULL,
+                           NULL),
+    BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+);
 
 static const char *phy2str(uint8_t phy)
 {
@@ -102,25 +108,6 @@ static const char *phy2str(uint8_t phy)
 	}
 }
 
-static void update_phy(struct bt_conn *conn,
-                       const uint8_t phyrx,
-                       const uint8_t phytx)
-{
-	int err;
-	const struct bt_conn_le_phy_param preferred_phy = {
-	    .options = BT_CONN_LE_PHY_OPT_NONE,
-	    .pref_rx_phy = phyrx,
-	    .pref_tx_phy = phytx,
-	};
-	err = bt_conn_le_phy_update(conn, &preferred_phy);
-	if (err) {
-		printk("bt_conn_le_phy_update() returned %d\n", err);
-	} else {
-		printf("Requested change to TX PHY %s, RX PHY %s PHY\n",
-		       phy2str(phytx), phy2str(phyrx));
-	}
-}
-
 ssize_t static write_cmd_cb(struct bt_conn *conn,
                             const struct bt_gatt_attr *attr,
                             const void *buf,
@@ -129,59 +116,49 @@ ssize_t static write_cmd_cb(struct bt_conn *conn,
                             uint8_t flags)
 {
 	const uint8_t *dptr = (const uint8_t*)buf;
+	struct link *link = &m_links[bt_conn_index(conn)];
+	int err = 0;
 	if (len >= 2) {
 		if (dptr[0] == 0x01) {
 			// set notification streaming on buf[1]
 			const bool streaming = dptr[1] == 0x01;
-			m_notif_send = streaming;
-			workqueue_item_t wqi = {.tasktype = SET_PREFERRED_PHY};
+			link->notif_send = streaming;
 			if (streaming) {
-				wqi.pref_phy_opts.rx_phytype = BT_GAP_LE_PHY_2M;
-				wqi.pref_phy_opts.tx_phytype = BT_GAP_LE_PHY_2M;
+				profile_apply(conn);
 			} else {
-				wqi.pref_phy_opts.rx_phytype = BT_GAP_LE_PHY_1M;
-				wqi.pref_phy_opts.tx_phytype = BT_GAP_LE_PHY_1M;
+				link_proc_phy(conn, BT_CONN_LE_PHY_PARAM_1M);
+			}
+		} else if (dptr[0] == 0x02) {
+			// select streaming profile buf[1], see enum stream_profile
+			err = profile_select(conn, dptr[1]);
+			if (err == 0) {
+				profile_apply(conn);
 			}
-			k_msgq_put(&work_msgq, &wqi, K_NO_WAIT);
+		} else if (dptr[0] == 0x03) {
+			// connection event extension on buf[1], all links
+			err = conn_event_extend_set(dptr[1] == 0x01);
+		} else if (dptr[0] == 0x04 && len >= 5) {
+			// connection event length in us, little endian
+			err = conn_event_len_set(sys_get_le32(&dptr[1]));
+		} else if (dptr[0] != 0x05) {
+			// 0x05 only asks for the response, to measure latency
+			err = -ENOTSUP;
 		}
+
+		// Acknowledge on the control characteristic: opcode, argument
+		// and status, ahead of any queued bulk data
+		const uint8_t rsp[] = { dptr[0], dptr[1], err ? 0x01 : 0x00 };
+
+		ctrl_send(conn, rsp, sizeof(rsp));
 	}
 	return len;
 }
 
 static void notif_ccc_cb(const struct bt_gatt_attr *attr, uint16_t value) 
 {
-	m_notif_enabled = (value & BT_GATT_CCC_NOTIFY) ? true : false;
-}
-
-// Write to the notification characteristic fragmenting at MTU as quickly as possible
-static int send_data(void *data, const uint16_t len, struct bt_gatt_attr *attr)
-{
-	if (default_conn == NULL) {
-		return -ENODEV;
-	}
-	int err = 0;
-
-	const uint16_t mtu = m_mtu;
-	if (len <= (mtu - MTU_OVERHEAD)) {
-		err = bt_gatt_notify(default_conn, attr, data, len);
-	} else {
-		const uint8_t *frag = (const uint8_t *)data;
-		uint16_t frag_len = mtu- MTU_OVERHEAD;
-		uint16_t remaining_len = len - frag_len;
-		err = bt_gatt_notify(default_conn, attr, frag, frag_len);
-		while(!err && remaining_len > 0) {
-			frag += frag_len;
-			if (remaining_len <= (mtu - MTU_OVERHEAD)) {
-				frag_len = remaining_len;
-				remaining_len = 0;
-			} else {
-				remaining_len -= frag_len;
-			}
-			
-			err = bt_gatt_notify(default_conn, attr, frag, frag_len);
-		} 
-	}
-	return err;
+	// Subscription state is per connection, see bt_gatt_is_subscribed()
+	printk("Notifications %s\n",
+	       (value & BT_GATT_CCC_NOTIFY) ? "enabled" : "disabled");
 }
 
 static void connected(struct bt_conn *conn, uint8_t hci_err)
@@ -199,63 +176,68 @@ static void connected(struct bt_conn *conn, uint8_t hci_err)
 		return;
 	}
 
-	if (default_conn) {
-		printk("Connection exists, disconnect second connection\n");
-		bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
-		return;
-	}
-
-	default_conn = bt_conn_ref(conn);
+	struct link *link = &m_links[bt_conn_index(conn)];
 
-	err = bt_conn_get_info(default_conn, &info);
-	if (err) {
-		printk("Failed to get connection info %d\n", err);
-		return;
+	link->conn = bt_conn_ref(conn);
+	link->notif_send = false;
+	link->mtu = 23;
+	link->msg_idx_cnt = 0;
+	link->msg_offset = 0;
+	link->payload_cap = 0;
+	if (IS_ENABLED(CONFIG_THROUGHPUT_SELF_CHECK)) {
+		selfcheck_reset(conn);
 	}
-	m_mtu = 23;
-	printk("Conn. interval is %u units\n", info.le.interval);
 
-}
-
-
-static void adv_start(void)
-{
-	struct bt_le_adv_param *adv_param =
-		BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE |
-		                BT_LE_ADV_OPT_ONE_TIME,
-		                BT_GAP_ADV_FAST_INT_MIN_2,
-		                BT_GAP_ADV_FAST_INT_MAX_2,
-		                NULL);
-	int err;
-
-	err = bt_le_adv_start(adv_param, ad, ARRAY_SIZE(ad), sd,
-	                      ARRAY_SIZE(sd));
+	err = bt_conn_get_info(conn, &info);
 	if (err) {
-		printk("Failed to start advertiser (%d)\n", err);
-		return;
+		printk("Failed to get connection info %d\n", err);
+	} else {
+		printk("Conn. interval is %u units\n", info.le.interval);
 	}
+	boot_mark(BOOT_CONNECTED);
+	stream_reset(conn);
+	matrix_link_changed(conn);
+	link_proc_connected(conn);
+	profile_connected(conn);
+	conn_event_connected(conn);
+	// Bring the link up one procedure at a time instead of letting the
+	// host's automatic updates race each other
+	profile_apply(conn);
+	adv_connected(conn);
+	watchdog_start(conn);
+	chan_mon_connected(conn);
+	telemetry_connected(conn);
+	steady_connected(conn);
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
-	struct bt_conn_info info = {0};
-	int err;
+	struct link *link = &m_links[bt_conn_index(conn)];
 
 	printk("Disconnected (reason 0x%02x)\n", reason);
 
-	test_ready = false;
-	if (default_conn) {
-		bt_conn_unref(default_conn);
-		default_conn = NULL;
+	watchdog_stop(conn);
+	chan_mon_disconnected(conn);
+	telemetry_disconnected(conn);
+	steady_disconnected(conn);
+	stream_disconnected(conn);
+	matrix_disconnected(conn);
+	link_proc_disconnected(conn);
+	profile_disconnected(conn);
+	conn_event_disconnected(conn);
+	if (link->conn) {
+		link->notif_send = false;
+		bt_conn_unref(link->conn);
+		link->conn = NULL;
 	}
 
-	err = bt_conn_get_info(conn, &info);
-	if (err) {
-		printk("Failed to get connection info (%d)\n", err);
-		return;
-	}
+	/* Keep a connectable advertiser running below the connection limit */
+	adv_disconnected(conn);
+}
 
-	/* Re-connect using same roles */
+static void recycled(void)
+{
+	/* A connection object became free, advertising may start now */
 	adv_start();
 }
 
@@ -275,6 +257,8 @@ static void le_param_updated(struct bt_conn *conn, uint16_t interval,
 	printk("Connection parameters updated.\n"
 	       " interval: %d, latency: %d, timeout: %d\n",
 	       interval, latency, timeout);
+	matrix_link_changed(conn);
+	link_proc_done(conn, LINK_PROC_CONN_PARAM);
 }
 
 static void le_phy_updated(struct bt_conn *conn,
@@ -282,7 +266,8 @@ static void le_phy_updated(struct bt_conn *conn,
 {
 	printk("LE PHY updated: TX PHY %s, RX PHY %s\n",
 	       phy2str(param->tx_phy), phy2str(param->rx_phy));
-
+	matrix_link_changed(conn);
+	link_proc_done(conn, LINK_PROC_PHY);
 }
 
 static void le_data_length_updated(struct bt_conn *conn,
@@ -292,11 +277,13 @@ static void le_data_length_updated(struct bt_conn *conn,
 	printk("LE data len updated: TX (len: %d time: %d)"
 	       " RX (len: %d time: %d)\n", info->tx_max_len,
 	       info->tx_max_time, info->rx_max_len, info->rx_max_time);
+	link_proc_done(conn, LINK_PROC_DATA_LEN);
 }
 
 BT_CONN_CB_DEFINE(conn_callbacks) = {
 	.connected = connected,
 	.disconnected = disconnected,
+	.recycled = recycled,
 	.le_param_req = le_param_req,
 	.le_param_updated = le_param_updated,
 	.le_phy_updated = le_phy_updated,
@@ -306,10 +293,8 @@ BT_CONN_CB_DEFINE(conn_callbacks) = {
 void mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
 {
 	printk("Updated MTU: TX: %d RX: %d bytes\n", tx, rx);
-	m_mtu = tx;
-	if (m_mtu >= CONFIG_BT_L2CAP_TX_MTU) {
-		m_mtu = CONFIG_BT_L2CAP_TX_MTU;
-	}
+	m_links[bt_conn_index(conn)].mtu = MIN(tx, CONFIG_BT_L2CAP_TX_MTU);
+	steady_mtu_updated(conn);
 }
 
 static struct bt_gatt_cb gatt_callbacks = {
@@ -317,67 +302,297 @@ static struct bt_gatt_cb gatt_callbacks = {
 };
 
 
+// Given when the idle notify thread has something to send
+static K_SEM_DEFINE(wake_sem, 0, 1);
+
+#if defined(CONFIG_THROUGHPUT_PRODUCER_THREAD)
+// Payloads queued per link, the rest of the pool is left to other links
+#define LINK_QUEUE_DEPTH MAX(CONFIG_THROUGHPUT_PAYLOAD_BUFS / CONFIG_BT_MAX_CONN, 1)
+
+// Given whenever a payload is freed
+static K_SEM_DEFINE(space_sem, 0, 1);
+#endif
+
+BUILD_ASSERT(CONFIG_THROUGHPUT_FIXED_MTU == 0 ||
+             CONFIG_THROUGHPUT_FIXED_MTU > MTU_OVERHEAD,
+             "Fixed MTU leaves no room for a payload");
+
+// MTU left to a notification's own ATT header and payload. Bulk payloads
+// sized to it fill a multiple handle value PDU on their own, so the host
+// never merges them and every one keeps its completion callback.
+static uint16_t link_mtu(const struct link *link)
+{
+	return transport_notify_multi(link->conn) ?
+	       link->mtu - NOTIFY_MULTI_OVERHEAD : link->mtu;
+}
+
+static bool link_streaming(const struct link *link)
+{
+	// Soak tests stream for as long as the central stays subscribed
+	return link->conn &&
+	       (link->notif_send || IS_ENABLED(CONFIG_THROUGHPUT_SOAK)) &&
+	       link_mtu(link) >= CONFIG_THROUGHPUT_FIXED_MTU &&
+	       bt_gatt_is_subscribed(link->conn, &m_svc.attrs[3],
+	                             BT_GATT_CCC_NOTIFY);
+}
+
+static inline void payload_source(struct link *link, uint8_t *data,
+                                  uint16_t len)
+{
+	if (IS_ENABLED(CONFIG_THROUGHPUT_SOURCE_PATTERN)) {
+		payload_fill(data, len, &link->msg_idx_cnt);
+		if (IS_ENABLED(CONFIG_THROUGHPUT_SELF_CHECK)) {
+			selfcheck_feed(link->conn, data, len);
+		}
+	}
+}
+
+static struct payload *payload_produce(struct link *link, k_timeout_t timeout)
+{
+	struct payload *msg = payload_alloc(timeout);
+	uint16_t len;
+
+	if (!msg) {
+		return NULL;
+	}
+
+	// Ensure each notification fits nicely without fragmenting.
+	len = MIN(link_mtu(link) - MTU_OVERHEAD,
+	          profile_payload_max(link->conn));
+	if (link->payload_cap) {
+		len = MIN(len, link->payload_cap);
+	}
+
+	if (CONFIG_THROUGHPUT_FIXED_MTU &&
+	    len >= CONFIG_THROUGHPUT_FIXED_MTU - MTU_OVERHEAD) {
+		// Constant length, the fill loop can be unrolled
+		msg->len = CONFIG_THROUGHPUT_FIXED_MTU - MTU_OVERHEAD;
+		payload_source(link, msg->data,
+		               CONFIG_THROUGHPUT_FIXED_MTU - MTU_OVERHEAD);
+	} else {
+		// Capped below the fixed MTU by the profile or a sweep
+		msg->len = len;
+		payload_source(link, msg->data, len);
+	}
+
+	return msg;
+}
+
+void link_stream(struct bt_conn *conn, bool enable)
+{
+	m_links[bt_conn_index(conn)].notif_send = enable;
+	k_sem_give(&wake_sem);
+}
+
+void link_payload_cap(struct bt_conn *conn, uint16_t len)
+{
+	m_links[bt_conn_index(conn)].payload_cap = len;
+}
+
+static void link_release(struct link *link)
+{
+#if defined(CONFIG_THROUGHPUT_PRODUCER_THREAD)
+	struct payload *msg;
+#endif
+
+	if (link->msg) {
+		payload_free(link->msg);
+		link->msg = NULL;
+	}
+#if defined(CONFIG_THROUGHPUT_PRODUCER_THREAD)
+	while ((msg = k_fifo_get(&link->ready, K_NO_WAIT)) != NULL) {
+		atomic_dec(&link->queued);
+		payload_free(msg);
+	}
+	k_sem_give(&space_sem);
+#endif
+}
+
+// Send the pending buffer of one link, taking a new one when it is done.
+// Returns true if the link made progress or has to be retried right away.
+static bool link_pump(struct link *link)
+{
+	int err;
+
+	if (!link_streaming(link)) {
+		link_release(link);
+		return false;
+	}
+
+	if (!link->msg) {
+#if defined(CONFIG_THROUGHPUT_PRODUCER_THREAD)
+		link->msg = k_fifo_get(&link->ready, K_NO_WAIT);
+		if (!link->msg) {
+			return false;
+		}
+		atomic_dec(&link->queued);
+		k_sem_give(&space_sem);
+#else
+		link->msg = payload_produce(link, K_NO_WAIT);
+		if (!link->msg) {
+			return false;
+		}
+#endif
+		link->msg_offset = 0;
+	}
+
+	err = stream_send(link->conn, &m_svc.attrs[3], link->msg->data,
+	                  link->msg->len, link_mtu(link), &link->msg_offset);
+	if (err == -ENOTCONN || err == -ENODEV) {
+		printk("Link lost, stopping stream (err %d)\n", err);
+		link->notif_send = false;
+	} else if (err && err != -EAGAIN) {
+		// Keep the unsent remainder and retry after a short pause.
+		printk("stream_send() returned %d at offset %u\n",
+		       err, link->msg_offset);
+		k_msleep(10);
+	}
+
+	if (link->msg_offset >= link->msg->len) {
+		payload_free(link->msg);
+		link->msg = NULL;
+	}
+
+	return true;
+}
+
 // Thread to pump data out the notification as quickly as possible
 static void notify_thread(void *, void *, void *)
 {
-	workqueue_item_t wq = {0};
+#if defined(CONFIG_THROUGHPUT_TX_COOP)
+	uint32_t rounds = 0;
+#endif
+
 	// Message pump for the notification characteristic
 	while(1) {
-		if (m_notif_enabled && m_notif_send) {
-			// Ensure each notification fits nicely without fragmenting.
-			const size_t len = m_mtu - MTU_OVERHEAD;
-			for (int i = 0; i < len; i++) {
-				const uint8_t shift = (m_msg_idx_cnt & 1) ? 9 : 1;
-				m_msg_buffer[i] = (m_msg_idx_cnt++ >> shift) & 0xFF;
-			}
-			if (m_msg_idx_cnt > (UINT16_MAX << 1)) {
-				m_msg_idx_cnt %= (UINT16_MAX << 1);
-			}
-			send_data(m_msg_buffer, len, &m_attrs[3]);
-		} else {
-			k_msleep(100);
+		bool busy = false;
+
+		// Round-robin one buffer per streaming link, control
+		// notifications go first at every buffer boundary
+		for (size_t i = 0; i < ARRAY_SIZE(m_links); i++) {
+			ctrl_flush();
+			busy |= link_pump(&m_links[i]);
 		}
-		
-		while(k_msgq_get(&work_msgq, &wq, K_NO_WAIT) == 0) {
-			switch(wq.tasktype) {
-				case SET_PREFERRED_PHY:
-					if (default_conn) {
-						update_phy(default_conn,
-						           wq.pref_phy_opts.rx_phytype,
-						           wq.pref_phy_opts.tx_phytype);
-					}
-					break;
-				default:
-					printk("Unrecognized workqueue type: %d\n", wq.tasktype);
-					break;
-			}
+#if defined(CONFIG_THROUGHPUT_TX_COOP)
+		// Bounded work per wake, nothing preempts a cooperative thread
+		if (busy && ++rounds >= CONFIG_THROUGHPUT_TX_BURST) {
+			rounds = 0;
+			stream_tx_wait(K_MSEC(10));
+		}
+#endif
+		if (!busy) {
+			k_sem_take(&wake_sem, K_MSEC(100));
+		} else if (CONFIG_THROUGHPUT_PACE_US > 0) {
+			k_usleep(CONFIG_THROUGHPUT_PACE_US);
 		}
 	}
 }
 
 #define NOTIFY_THREAD_STACKSIZE 2048
+#if defined(CONFIG_THROUGHPUT_TX_COOP)
+// Lowest cooperative priority, still below the Bluetooth host threads
+#define NOTIFY_THREAD_PRIORITY  K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1)
+#else
 #define NOTIFY_THREAD_PRIORITY  8
+#endif
 K_THREAD_DEFINE(notify_thread_id, NOTIFY_THREAD_STACKSIZE, notify_thread,
                 NULL, NULL, NULL, // unused args
                 NOTIFY_THREAD_PRIORITY, 0, 0);
 
+#if defined(CONFIG_THROUGHPUT_PRODUCER_THREAD)
+// Thread to generate payloads ahead of the notify thread, which only sends
+static void producer_thread(void *, void *, void *)
+{
+	while (1) {
+		bool produced = false;
+
+		for (size_t i = 0; i < ARRAY_SIZE(m_links); i++) {
+			struct link *link = &m_links[i];
+			struct payload *msg;
+
+			if (!link_streaming(link) ||
+			    atomic_get(&link->queued) >= LINK_QUEUE_DEPTH) {
+				continue;
+			}
+
+			msg = payload_produce(link, K_NO_WAIT);
+			if (!msg) {
+				break;
+			}
+			atomic_inc(&link->queued);
+			k_fifo_put(&link->ready, msg);
+			k_sem_give(&wake_sem);
+			produced = true;
+		}
+		if (!produced) {
+			// Queues full or nobody streaming
+			k_sem_take(&space_sem, K_MSEC(100));
+		}
+	}
+}
+
+#define PRODUCER_THREAD_STACKSIZE 1024
+#define PRODUCER_THREAD_PRIORITY  10
+K_THREAD_DEFINE(producer_thread_id, PRODUCER_THREAD_STACKSIZE,
+                producer_thread, NULL, NULL, NULL,
+                PRODUCER_THREAD_PRIORITY, 0, 0);
+
+// Before either thread starts
+static int link_queues_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_links); i++) {
+		k_fifo_init(&m_links[i].ready);
+	}
+
+	return 0;
+}
+
+SYS_INIT(link_queues_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif /* CONFIG_THROUGHPUT_PRODUCER_THREAD */
+
+static K_SEM_DEFINE(bt_wake_sem, 0, 1);
+static int m_bt_err;
+
+static void bt_ready(int err)
+{
+	m_bt_err = err;
+	if (!err) {
+		boot_mark(BOOT_BT_READY);
+		chan_mon_init();
+		conn_event_init();
+	}
+	k_sem_give(&bt_wake_sem);
+}
+
 int main(void)
 {
 	int err;
 
 	printk("Starting Bluetooth Throughput example v1.0.2\n");
 
-	err = bt_enable(NULL);
+	bt_gatt_cb_register(&gatt_callbacks);
+	ctrl_init(&m_svc.attrs[6], &wake_sem);
+
+	err = bt_enable(bt_ready);
 	if (err) {
 		printk("Bluetooth init failed (err %d)\n", err);
 		return 0;
 	}
 
-	printk("Bluetooth initialized\n");
-	
+	k_sem_take(&bt_wake_sem, K_FOREVER);
+	if (m_bt_err) {
+		printk("Bluetooth init failed (err %d)\n", m_bt_err);
+		return 0;
+	}
+
+	if (IS_ENABLED(CONFIG_BT_SETTINGS)) {
+		// The host is not ready to advertise until settings are loaded
+		settings_load();
+		boot_mark(BOOT_SETTINGS_LOADED);
+	}
+
 	printk("\nStarting advertising\n");
-	bt_gatt_cb_register(&gatt_callbacks);
-	bt_gatt_service_register(&m_svcs);
 	adv_start();
+
 	return 0;
 }
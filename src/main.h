@@ -7,6 +7,8 @@
 #ifndef THROUGHPUT_MAIN_H_
 #define THROUGHPUT_MAIN_H_
 
+#include <zephyr/bluetooth/conn.h>
+
 /**
  * @brief Run the test
  *
@@ -27,4 +29,24 @@ int test_run(const struct shell *shell,
  */
 void select_role(bool is_central);
 
+/**
+ * @brief Start or stop streaming to a connection.
+ *
+ * Unlike the start command, the PHY and data length are left as they are.
+ *
+ * @param conn   Connection.
+ * @param enable true to stream.
+ */
+void link_stream(struct bt_conn *conn, bool enable);
+
+/**
+ * @brief Limit the notification payload of a connection.
+ *
+ * Applies on top of the negotiated MTU and the streaming profile.
+ *
+ * @param conn Connection.
+ * @param len  Largest payload in bytes, 0 for no limit.
+ */
+void link_payload_cap(struct bt_conn *conn, uint16_t len);
+
 #endif /* THROUGHPUT_MAIN_H_ */
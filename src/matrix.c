@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+#include "hist.h"
+#include "matrix.h"
+
+#define MATRIX_CELLS CONFIG_THROUGHPUT_MATRIX_CELLS
+
+/* Results for one PHY and connection interval combination */
+struct matrix_cell {
+	uint8_t tx_phy;
+	uint16_t interval;
+	uint64_t bytes;
+	int64_t active_ms;
+	uint32_t tx_packets;
+	uint32_t retransmits;
+	struct log2_hist latency_us;
+};
+
+static struct k_spinlock m_lock;
+static struct matrix_cell m_cells[MATRIX_CELLS];
+static size_t m_cell_cnt;
+static uint32_t m_cell_overflow;
+
+/* Current cell of each connection and the span of its completions */
+static struct {
+	struct matrix_cell *cell;
+	int64_t first_ms;
+	int64_t last_ms;
+} m_conn[CONFIG_BT_MAX_CONN];
+
+static struct matrix_cell *cell_get(uint8_t tx_phy, uint16_t interval)
+{
+	for (size_t i = 0; i < m_cell_cnt; i++) {
+		if (m_cells[i].tx_phy == tx_phy &&
+		    m_cells[i].interval == interval) {
+			return &m_cells[i];
+		}
+	}
+
+	if (m_cell_cnt == MATRIX_CELLS) {
+		m_cell_overflow++;
+		return NULL;
+	}
+
+	m_cells[m_cell_cnt].tx_phy = tx_phy;
+	m_cells[m_cell_cnt].interval = interval;
+	return &m_cells[m_cell_cnt++];
+}
+
+// Goodput is measured between completions, so idle time does not count
+static void stint_close(uint8_t idx)
+{
+	if (m_conn[idx].cell && m_conn[idx].first_ms) {
+		m_conn[idx].cell->active_ms +=
+			m_conn[idx].last_ms - m_conn[idx].first_ms;
+	}
+	m_conn[idx].cell = NULL;
+	m_conn[idx].first_ms = 0;
+}
+
+void matrix_link_changed(struct bt_conn *conn)
+{
+	const uint8_t idx = bt_conn_index(conn);
+	struct bt_conn_info info;
+	k_spinlock_key_t key;
+
+	if (bt_conn_get_info(conn, &info)) {
+		return;
+	}
+
+	key = k_spin_lock(&m_lock);
+	stint_close(idx);
+	m_conn[idx].cell = cell_get(info.le.phy->tx_phy, info.le.interval);
+	k_spin_unlock(&m_lock, key);
+}
+
+void matrix_disconnected(struct bt_conn *conn)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	stint_close(bt_conn_index(conn));
+	k_spin_unlock(&m_lock, key);
+}
+
+void matrix_link_packets(struct bt_conn *conn, uint32_t tx,
+                         uint32_t retransmits)
+{
+	const uint8_t idx = bt_conn_index(conn);
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+	struct matrix_cell *cell = m_conn[idx].cell;
+
+	if (cell) {
+		cell->tx_packets += tx;
+		cell->retransmits += retransmits;
+	}
+	k_spin_unlock(&m_lock, key);
+}
+
+void matrix_record(struct bt_conn *conn, uint16_t len, uint32_t latency_us)
+{
+	const uint8_t idx = bt_conn_index(conn);
+	const int64_t now = k_uptime_get();
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+	struct matrix_cell *cell = m_conn[idx].cell;
+
+	if (cell) {
+		if (!m_conn[idx].first_ms) {
+			m_conn[idx].first_ms = now;
+		} else {
+			cell->bytes += len;
+		}
+		m_conn[idx].last_ms = now;
+		hist_add(&cell->latency_us, latency_us);
+	}
+	k_spin_unlock(&m_lock, key);
+}
+
+static int cmd_matrix(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "phy,interval,bytes,active_ms,goodput_Bps,"
+	            "lat_p50_us,lat_p90_us,lat_p99_us,tx_packets,retransmits,"
+	            "retx_permille");
+
+	for (size_t i = 0; i < m_cell_cnt; i++) {
+		const struct matrix_cell *cell = &m_cells[i];
+
+		shell_print(sh, "%u,%u,%llu,%lld,%llu,%u,%u,%u,%u,%u,%u",
+		            cell->tx_phy, cell->interval, cell->bytes,
+		            cell->active_ms,
+		            cell->active_ms ?
+		            cell->bytes * 1000 / cell->active_ms : 0,
+		            hist_percentile(&cell->latency_us, 50),
+		            hist_percentile(&cell->latency_us, 90),
+		            hist_percentile(&cell->latency_us, 99),
+		            cell->tx_packets, cell->retransmits,
+		            cell->tx_packets ? (uint32_t)((uint64_t)
+		            cell->retransmits * 1000 / cell->tx_packets) : 0);
+	}
+	if (m_cell_overflow) {
+		shell_warn(sh, "%u link changes did not fit in the matrix",
+		           m_cell_overflow);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		k_spinlock_key_t key = k_spin_lock(&m_lock);
+		uint8_t tx_phy[ARRAY_SIZE(m_conn)];
+		uint16_t interval[ARRAY_SIZE(m_conn)];
+
+		/* Live links keep recording into a fresh cell of their
+		 * current PHY and interval, starting a new stint.
+		 */
+		for (size_t i = 0; i < ARRAY_SIZE(m_conn); i++) {
+			if (m_conn[i].cell) {
+				tx_phy[i] = m_conn[i].cell->tx_phy;
+				interval[i] = m_conn[i].cell->interval;
+			}
+		}
+		memset(m_cells, 0, sizeof(m_cells));
+		m_cell_cnt = 0;
+		m_cell_overflow = 0;
+		for (size_t i = 0; i < ARRAY_SIZE(m_conn); i++) {
+			if (m_conn[i].cell) {
+				m_conn[i].cell = cell_get(tx_phy[i],
+				                          interval[i]);
+			}
+			m_conn[i].first_ms = 0;
+			m_conn[i].last_ms = 0;
+		}
+		k_spin_unlock(&m_lock, key);
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), matrix, NULL,
+                 "Print goodput and latency per PHY and connection interval "
+                 "as CSV [reset]", cmd_matrix, 1, 1);
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_MATRIX_H_
+#define THROUGHPUT_MATRIX_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * @brief Start attributing a connection's samples to its current PHY and
+ *        connection interval.
+ *
+ * Call on connection and after every PHY or connection parameter update.
+ *
+ * @param conn Connection.
+ */
+void matrix_link_changed(struct bt_conn *conn);
+
+/**
+ * @brief Stop attributing samples of a connection.
+ *
+ * @param conn Connection that went away.
+ */
+void matrix_disconnected(struct bt_conn *conn);
+
+/**
+ * @brief Record link layer packets sent in one connection event.
+ *
+ * @param conn        Connection.
+ * @param tx          Packets transmitted.
+ * @param retransmits Packets the peer did not acknowledge.
+ */
+void matrix_link_packets(struct bt_conn *conn, uint32_t tx,
+                         uint32_t retransmits);
+
+/**
+ * @brief Record a completed notification.
+ *
+ * @param conn       Connection.
+ * @param len        Payload bytes.
+ * @param latency_us Time from notify call to TX completion.
+ */
+void matrix_record(struct bt_conn *conn, uint16_t len, uint32_t latency_us);
+
+#endif /* THROUGHPUT_MATRIX_H_ */
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_PATTERN_H_
+#define THROUGHPUT_PATTERN_H_
+
+/* Plain C so the generator and the validator build on a host as well */
+#include <stdint.h>
+
+/* The pattern index is wrapped at the end of every payload */
+#define PATTERN_WRAP ((uint32_t)UINT16_MAX << 1)
+
+/**
+ * @brief Byte of the test pattern at an index.
+ *
+ * Even indexes carry bits 1..8 of the index, odd ones bits 9..16.
+ */
+static inline uint8_t pattern_byte(uint32_t idx)
+{
+	return (idx >> ((idx & 1) ? 9 : 1)) & 0xFF;
+}
+
+/** @brief Index of the next payload after one that ended at @p idx. */
+static inline uint32_t pattern_wrap(uint32_t idx)
+{
+	return idx > PATTERN_WRAP ? idx % PATTERN_WRAP : idx;
+}
+
+#endif /* THROUGHPUT_PATTERN_H_ */
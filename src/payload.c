@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/atomic.h>
+
+#include "payload.h"
+
+static struct payload m_pool[CONFIG_THROUGHPUT_PAYLOAD_BUFS];
+static K_FIFO_DEFINE(m_free);
+static atomic_t m_free_cnt;
+static atomic_t m_free_min;
+
+struct payload *payload_alloc(k_timeout_t timeout)
+{
+	struct payload *payload = k_fifo_get(&m_free, timeout);
+	atomic_val_t free_cnt;
+
+	if (payload) {
+		free_cnt = atomic_dec(&m_free_cnt) - 1;
+		if (free_cnt < atomic_get(&m_free_min)) {
+			atomic_set(&m_free_min, free_cnt);
+		}
+	}
+
+	return payload;
+}
+
+void payload_free(struct payload *payload)
+{
+	atomic_inc(&m_free_cnt);
+	k_fifo_put(&m_free, payload);
+}
+
+uint32_t payload_free_min(bool reset)
+{
+	const atomic_val_t min = atomic_get(&m_free_min);
+
+	if (reset) {
+		atomic_set(&m_free_min, atomic_get(&m_free_cnt));
+	}
+
+	return min;
+}
+
+/* Before the application threads start */
+static int payload_pool_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_pool); i++) {
+		k_fifo_put(&m_free, &m_pool[i]);
+	}
+	atomic_set(&m_free_cnt, ARRAY_SIZE(m_pool));
+	atomic_set(&m_free_min, ARRAY_SIZE(m_pool));
+
+	return 0;
+}
+
+SYS_INIT(payload_pool_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_PAYLOAD_H_
+#define THROUGHPUT_PAYLOAD_H_
+
+#include <zephyr/kernel.h>
+
+#include "pattern.h"
+#include "stream.h"
+
+/** @brief Largest payload, one notification at the maximum ATT MTU. */
+#define PAYLOAD_MAX (CONFIG_BT_L2CAP_TX_MTU - MTU_OVERHEAD)
+
+/** @brief Payload buffer handed from producer to sender without copying. */
+struct payload {
+	void *fifo_reserved;
+	uint16_t len;
+	uint8_t data[PAYLOAD_MAX];
+};
+
+/**
+ * @brief Take a buffer from the payload pool.
+ *
+ * @param timeout Time to wait for a buffer to be freed.
+ *
+ * @return Buffer, or NULL if none became free in time.
+ */
+struct payload *payload_alloc(k_timeout_t timeout);
+
+/**
+ * @brief Return a buffer to the payload pool.
+ *
+ * @param payload Buffer from payload_alloc().
+ */
+void payload_free(struct payload *payload);
+
+/**
+ * @brief Lowest number of free payload buffers seen.
+ *
+ * @param reset Start a new low-water mark from the current free count.
+ *
+ * @return Low-water mark since boot or the previous reset.
+ */
+uint32_t payload_free_min(bool reset);
+
+/**
+ * @brief Fill a buffer with the test pattern.
+ *
+ * Each byte is taken from a running index, alternately its low and high
+ * byte, so the receiver can detect loss and reordering. Inline so that a
+ * compile-time length, see CONFIG_THROUGHPUT_FIXED_MTU, unrolls the loop.
+ *
+ * @param buf Destination.
+ * @param len Number of bytes.
+ * @param idx Pattern index, advanced past the generated bytes.
+ */
+static inline void payload_fill(uint8_t *buf, size_t len, uint32_t *idx)
+{
+	uint32_t i = *idx;
+
+	for (size_t n = 0; n < len; n++) {
+		buf[n] = pattern_byte(i + n);
+	}
+	*idx = pattern_wrap(i + len);
+}
+
+#endif /* THROUGHPUT_PAYLOAD_H_ */
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "stream.h"
+
+/* Totals at the previous "throughput pipeline" */
+static uint64_t m_mark_busy;
+static uint64_t m_mark_bytes;
+static uint32_t m_mark_notifications;
+
+static int cmd_pipeline(const struct shell *sh, size_t argc, char **argv)
+{
+	k_thread_runtime_stats_t all;
+	const uint64_t acked = stream_bytes_acked_total();
+	const uint32_t notifications = stream_notifications_total();
+	uint64_t busy, bytes;
+	uint32_t cnt;
+
+	shell_print(sh, "source: %s, fixed mtu: %u, pace: %u us, "
+	            "instrument: %s, self check: %s",
+	            IS_ENABLED(CONFIG_THROUGHPUT_SOURCE_PATTERN) ? "pattern" :
+	                                                           "static",
+	            CONFIG_THROUGHPUT_FIXED_MTU,
+	            CONFIG_THROUGHPUT_PACE_US,
+	            IS_ENABLED(CONFIG_THROUGHPUT_INSTRUMENT) ? "on" : "off",
+	            IS_ENABLED(CONFIG_THROUGHPUT_SELF_CHECK) ? "on" : "off");
+
+	if (k_thread_runtime_stats_all_get(&all)) {
+		shell_error(sh, "Thread runtime statistics are not enabled");
+		return -ENOTSUP;
+	}
+
+	/* All CPU time except idle, Bluetooth host threads and ISRs included */
+	busy = all.total_cycles - m_mark_busy;
+	bytes = acked - m_mark_bytes;
+	cnt = notifications - m_mark_notifications;
+	if (cnt && bytes) {
+		shell_print(sh, "%u notifications, %llu cycles/notification, "
+		            "%llu cycles/byte", cnt, busy / cnt, busy / bytes);
+	} else {
+		shell_print(sh, "No notifications since the last call");
+	}
+
+	m_mark_busy = all.total_cycles;
+	m_mark_bytes = acked;
+	m_mark_notifications = notifications;
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), pipeline, NULL,
+                 "Print the send pipeline stages and CPU cycles per "
+                 "notification since the last call", cmd_pipeline, 1, 0);
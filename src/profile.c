@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+#include "chan_mon.h"
+#include "link_proc.h"
+#include "profile.h"
+#include "stream.h"
+
+/* L2CAP basic header + ATT notification header */
+#define PDU_OVERHEAD (4 + MTU_OVERHEAD)
+#define T_IFS_US 150
+/* Smallest valid maximum TX time on Coded PHY */
+#define CODED_TIME_MIN_US 2704
+
+static const char * const profile_name[PROFILE_COUNT] = {
+	[PROFILE_2M] = "2m",
+	[PROFILE_CODED_S2] = "s2",
+	[PROFILE_CODED_S8] = "s8",
+};
+
+static struct profile_ctx {
+	enum stream_profile profile;
+	uint16_t payload_max;
+	int64_t since_ms;
+	uint64_t since_bytes;
+	struct chan_mon_packets since_pkts;
+} m_ctx[CONFIG_BT_MAX_CONN];
+
+/* Time, acknowledged bytes and link layer packets on each profile,
+ * all connections
+ */
+static struct {
+	int64_t ms;
+	uint64_t bytes;
+	struct chan_mon_packets pkts;
+} m_totals[PROFILE_COUNT];
+
+static struct profile_ctx *ctx_of(const struct bt_conn *conn)
+{
+	return &m_ctx[bt_conn_index(conn)];
+}
+
+// Air time of an LL data PDU carrying len payload bytes
+static uint32_t pdu_time_us(enum stream_profile profile, uint16_t len)
+{
+	switch (profile) {
+	case PROFILE_CODED_S2:
+		/* Preamble, AA, CI, TERM1 at S=8, then 16 us/byte, TERM2 */
+		return 376 + (len + 5) * 16 + 6;
+	case PROFILE_CODED_S8:
+		return 376 + (len + 5) * 64 + 24;
+	default:
+		/* Preamble, AA, header, payload and CRC at 4 us/byte */
+		return (len + 11) * 4;
+	}
+}
+
+static void account(struct bt_conn *conn)
+{
+	struct profile_ctx *ctx = ctx_of(conn);
+	struct chan_mon_packets *total = &m_totals[ctx->profile].pkts;
+	struct stream_stats stats;
+	struct chan_mon_packets pkts;
+	const int64_t now = k_uptime_get();
+
+	stream_stats_get(conn, &stats);
+	m_totals[ctx->profile].ms += now - ctx->since_ms;
+	m_totals[ctx->profile].bytes += stats.bytes_acked - ctx->since_bytes;
+	ctx->since_ms = now;
+	ctx->since_bytes = stats.bytes_acked;
+
+	if (chan_mon_packets_get(conn, &pkts) == 0) {
+		total->tx += pkts.tx - ctx->since_pkts.tx;
+		total->tx_acked += pkts.tx_acked - ctx->since_pkts.tx_acked;
+		total->rx += pkts.rx - ctx->since_pkts.rx;
+		total->rx_crc_err += pkts.rx_crc_err -
+		                     ctx->since_pkts.rx_crc_err;
+		ctx->since_pkts = pkts;
+	}
+}
+
+void profile_connected(struct bt_conn *conn)
+{
+	struct profile_ctx *ctx = ctx_of(conn);
+
+	ctx->profile = PROFILE_2M;
+	ctx->payload_max = UINT16_MAX;
+	ctx->since_ms = k_uptime_get();
+	ctx->since_bytes = 0;
+	memset(&ctx->since_pkts, 0, sizeof(ctx->since_pkts));
+}
+
+void profile_disconnected(struct bt_conn *conn)
+{
+	account(conn);
+}
+
+int profile_select(struct bt_conn *conn, enum stream_profile profile)
+{
+	if (profile >= PROFILE_COUNT) {
+		return -EINVAL;
+	}
+
+	account(conn);
+	ctx_of(conn)->profile = profile;
+
+	return 0;
+}
+
+void profile_apply(struct bt_conn *conn)
+{
+	struct profile_ctx *ctx = ctx_of(conn);
+	struct bt_conn_le_phy_param phy = {
+		.options = BT_CONN_LE_PHY_OPT_NONE,
+		.pref_tx_phy = BT_GAP_LE_PHY_2M,
+		.pref_rx_phy = BT_GAP_LE_PHY_2M,
+	};
+	struct bt_conn_le_data_len_param data_len = {
+		.tx_max_len = BT_GAP_DATA_LEN_MAX,
+		.tx_max_time = BT_GAP_DATA_TIME_MAX,
+	};
+	struct bt_conn_info info;
+
+	if (ctx->profile == PROFILE_2M) {
+		ctx->payload_max = UINT16_MAX;
+		link_proc_data_len(conn, &data_len);
+		link_proc_phy(conn, &phy);
+		return;
+	}
+
+	phy.pref_tx_phy = BT_GAP_LE_PHY_CODED;
+	phy.pref_rx_phy = BT_GAP_LE_PHY_CODED;
+	phy.options = ctx->profile == PROFILE_CODED_S2 ?
+	              BT_CONN_LE_PHY_OPT_CODED_S2 :
+	              BT_CONN_LE_PHY_OPT_CODED_S8;
+
+	if (bt_conn_get_info(conn, &info) == 0) {
+		/* One full PDU and the empty acknowledgment per event. This
+		 * assumes an error-free link: every lost PDU or ack costs a
+		 * whole event, so goodput drops roughly with (1 - PER).
+		 */
+		const uint32_t event_us = info.le.interval * 1250;
+		const uint32_t ack_us = pdu_time_us(ctx->profile, 0) + 2 * T_IFS_US;
+		uint16_t len = BT_GAP_DATA_LEN_MAX;
+
+		while (len > BT_GAP_DATA_LEN_DEFAULT &&
+		       pdu_time_us(ctx->profile, len) + ack_us > event_us) {
+			len--;
+		}
+		data_len.tx_max_len = len;
+		data_len.tx_max_time = MAX(pdu_time_us(ctx->profile, len),
+		                           CODED_TIME_MIN_US);
+	}
+	ctx->payload_max = data_len.tx_max_len - PDU_OVERHEAD;
+
+	printk("Profile %s: data length %u (%u us), payload %u\n",
+	       profile_name[ctx->profile], data_len.tx_max_len,
+	       data_len.tx_max_time, ctx->payload_max);
+
+	/* PHY first so the data length time limit applies to Coded PHY */
+	link_proc_phy(conn, &phy);
+	link_proc_data_len(conn, &data_len);
+}
+
+uint16_t profile_payload_max(const struct bt_conn *conn)
+{
+	return ctx_of(conn)->payload_max;
+}
+
+static void apply_cb(struct bt_conn *conn, void *data)
+{
+	const enum stream_profile *profile = data;
+
+	if (profile_select(conn, *profile) == 0) {
+		profile_apply(conn);
+	}
+}
+
+static void account_cb(struct bt_conn *conn, void *data)
+{
+	account(conn);
+}
+
+static int cmd_profile(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc > 1) {
+		for (enum stream_profile p = 0; p < PROFILE_COUNT; p++) {
+			if (strcmp(argv[1], profile_name[p]) == 0) {
+				bt_conn_foreach(BT_CONN_TYPE_LE, apply_cb, &p);
+				return 0;
+			}
+		}
+		shell_error(sh, "Unknown profile %s", argv[1]);
+		return -EINVAL;
+	}
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, account_cb, NULL);
+	for (size_t i = 0; i < PROFILE_COUNT; i++) {
+		const int64_t ms = m_totals[i].ms;
+		const struct chan_mon_packets *p = &m_totals[i].pkts;
+		/* Lost PDUs and acknowledgments, see chan_mon_hint() */
+		const uint64_t packets = (uint64_t)p->tx + p->rx;
+		const uint64_t errors = (uint64_t)p->tx - p->tx_acked +
+		                        p->rx_crc_err;
+		const uint32_t per = packets ? errors * 1000 / packets : 0;
+
+		shell_print(sh, "%s: %lld ms, %llu bytes, %llu B/s, "
+		            "PER %u.%u%% of %llu packets",
+		            profile_name[i], ms, m_totals[i].bytes,
+		            ms ? m_totals[i].bytes * 1000 / ms : 0,
+		            per / 10, per % 10, packets);
+	}
+	if (!chan_mon_reports_enabled()) {
+		shell_print(sh, "PER needs the SoftDevice Controller and "
+		            "CONFIG_THROUGHPUT_CHAN_QOS_REPORT");
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), profile, NULL,
+                 "Select a streaming profile [2m|s2|s8] or print throughput "
+                 "per profile", cmd_profile, 1, 1);
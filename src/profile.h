@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_PROFILE_H_
+#define THROUGHPUT_PROFILE_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/** @brief Streaming profiles, values are used by the command protocol. */
+enum stream_profile {
+	PROFILE_2M = 0,       /* LE 2M, maximum data length */
+	PROFILE_CODED_S2 = 1, /* LE Coded S=2, ~500 kbps */
+	PROFILE_CODED_S8 = 2, /* LE Coded S=8, ~125 kbps, longest range */
+	PROFILE_COUNT,
+};
+
+/**
+ * @brief Reset a new connection to the default profile.
+ *
+ * @param conn New connection.
+ */
+void profile_connected(struct bt_conn *conn);
+
+/**
+ * @brief Account the time spent on the current profile of a connection.
+ *
+ * @param conn Connection that went away.
+ */
+void profile_disconnected(struct bt_conn *conn);
+
+/**
+ * @brief Select a streaming profile for a connection.
+ *
+ * Only records the selection, see profile_apply().
+ *
+ * @param conn    Connection.
+ * @param profile Profile to use for the next stream.
+ *
+ * @return 0 on success or -EINVAL for an unknown profile.
+ */
+int profile_select(struct bt_conn *conn, enum stream_profile profile);
+
+/**
+ * @brief Negotiate the PHY and data length of the selected profile.
+ *
+ * For Coded PHY the data length is reduced so that one data PDU and its
+ * acknowledgment fit in the current connection interval, and the
+ * notification payload is capped to a single PDU.
+ *
+ * @param conn Connection.
+ */
+void profile_apply(struct bt_conn *conn);
+
+/**
+ * @brief Largest notification payload the selected profile allows.
+ *
+ * @param conn Connection.
+ *
+ * @return Payload cap in bytes, UINT16_MAX when not limited.
+ */
+uint16_t profile_payload_max(const struct bt_conn *conn);
+
+#endif /* THROUGHPUT_PROFILE_H_ */
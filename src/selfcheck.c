@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/shell/shell.h>
+
+#include "selfcheck.h"
+#include "validator.h"
+
+static struct {
+	struct validator v;
+	uint64_t cycles;  /* Spent in validator_feed() */
+} m_check[CONFIG_BT_MAX_CONN];
+
+void selfcheck_reset(struct bt_conn *conn)
+{
+	const uint8_t i = bt_conn_index(conn);
+
+	validator_init(&m_check[i].v);
+	m_check[i].cycles = 0;
+}
+
+void selfcheck_feed(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	const uint8_t i = bt_conn_index(conn);
+	const uint32_t start = k_cycle_get_32();
+	enum validator_result result;
+
+	result = validator_feed(&m_check[i].v, data, len);
+	m_check[i].cycles += k_cycle_get_32() - start;
+
+	if (result != VALIDATOR_OK && result != VALIDATOR_SYNCED) {
+		printk("Self check: payload %u on conn %u failed (%d)\n",
+		       m_check[i].v.stats.notifications, i, result);
+	}
+}
+
+static int cmd_selfcheck(const struct shell *sh, size_t argc, char **argv)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_check); i++) {
+		const struct validator_stats *s = &m_check[i].v.stats;
+		const uint64_t bytes = s->bytes_ok + s->bytes_corrupt;
+
+		shell_print(sh, "conn %u: %u payloads, ok %llu, lost %llu, "
+		            "duplicate %llu, corrupt %llu, resyncs %u, "
+		            "%llu cycles/kB", i, s->notifications, s->bytes_ok,
+		            s->bytes_lost, s->bytes_duplicate, s->bytes_corrupt,
+		            s->resyncs,
+		            bytes ? m_check[i].cycles * 1024 / bytes : 0);
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), selfcheck, NULL,
+                 "Print results of validating generated payloads",
+                 cmd_selfcheck, 1, 0);
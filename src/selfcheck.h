@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_SELFCHECK_H_
+#define THROUGHPUT_SELFCHECK_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * @brief Restart validation of the stream of a new connection.
+ *
+ * @param conn New connection.
+ */
+void selfcheck_reset(struct bt_conn *conn);
+
+/**
+ * @brief Validate a generated payload before it is sent.
+ *
+ * @param conn Connection the payload is for.
+ * @param data Payload.
+ * @param len  Payload length.
+ */
+void selfcheck_feed(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+#endif /* THROUGHPUT_SELFCHECK_H_ */
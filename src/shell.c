@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/shell/shell.h>
+
+/* Root of the "throughput" command tree, modules attach to it with
+ * SHELL_SUBCMD_ADD((throughput), ...).
+ */
+SHELL_SUBCMD_SET_CREATE(throughput_cmds, (throughput));
+SHELL_CMD_REGISTER(throughput, &throughput_cmds,
+                   "Notification throughput commands", NULL);
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+#if defined(CONFIG_SYS_HEAP_RUNTIME_STATS) && (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+#include <zephyr/sys/sys_heap.h>
+#define HEAP_STATS 1
+#endif
+
+#include "payload.h"
+#include "stream.h"
+
+#define PERIOD_MS    (CONFIG_THROUGHPUT_SOAK_PERIOD_S * MSEC_PER_SEC)
+#define RING_SIZE    CONFIG_THROUGHPUT_SOAK_RING_SIZE
+#define DROP_PCT     CONFIG_THROUGHPUT_SOAK_DROP_PCT
+/* Streaming snapshots averaged into the baseline */
+#define BASELINE_CNT 3
+
+enum soak_flag {
+	SOAK_FLAG_DROP = BIT(0),     /* Goodput below baseline by DROP_PCT */
+	SOAK_FLAG_ERRORS = BIT(1),   /* Send errors other than -ENOMEM */
+	SOAK_FLAG_HEAP = BIT(2),     /* Heap use grew since the first snapshot */
+	SOAK_FLAG_NO_CONN = BIT(3),
+};
+
+struct soak_snapshot {
+	uint32_t uptime_s;
+	uint32_t goodput;      /* Bytes/s over the period */
+	uint32_t errors;       /* Send errors during the period */
+	uint32_t heap_used;
+	uint32_t heap_max;
+	uint8_t conn_cnt;
+	uint8_t pool_min;      /* Lowest free payload buffers in the period */
+	uint8_t flags;         /* enum soak_flag */
+};
+
+static struct soak_snapshot m_ring[RING_SIZE];
+static uint32_t m_snap_cnt;
+static uint32_t m_anomaly_cnt;
+
+static uint64_t m_mark_bytes;
+static uint32_t m_mark_errors;
+
+static uint64_t m_baseline_sum;
+static uint32_t m_baseline_cnt;
+static uint32_t m_heap_first;
+
+#if defined(HEAP_STATS)
+extern struct k_heap _system_heap;
+#endif
+
+static void snapshot_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_snapshot_work, snapshot_work_handler);
+
+static void conn_cb(struct bt_conn *conn, void *data)
+{
+	struct soak_snapshot *snap = data;
+
+	snap->conn_cnt++;
+}
+
+static uint8_t flags_of(struct soak_snapshot *snap)
+{
+	uint8_t flags = 0;
+
+	if (!snap->conn_cnt) {
+		return SOAK_FLAG_NO_CONN;
+	}
+
+	if (m_baseline_cnt < BASELINE_CNT) {
+		if (snap->goodput) {
+			m_baseline_sum += snap->goodput;
+			m_baseline_cnt++;
+		}
+	} else if ((uint64_t)snap->goodput * 100 * BASELINE_CNT <
+	           m_baseline_sum * (100 - DROP_PCT)) {
+		flags |= SOAK_FLAG_DROP;
+	}
+
+	if (snap->errors) {
+		flags |= SOAK_FLAG_ERRORS;
+	}
+	if (snap->heap_used > m_heap_first) {
+		flags |= SOAK_FLAG_HEAP;
+	}
+
+	return flags;
+}
+
+static void snapshot_work_handler(struct k_work *work)
+{
+	struct soak_snapshot *snap = &m_ring[m_snap_cnt % RING_SIZE];
+	const uint64_t acked = stream_bytes_acked_total();
+	const uint32_t errors = stream_errors_total();
+#if defined(HEAP_STATS)
+	struct sys_memory_stats heap;
+#endif
+
+	memset(snap, 0, sizeof(*snap));
+	snap->uptime_s = k_uptime_get() / MSEC_PER_SEC;
+	snap->goodput = (acked - m_mark_bytes) * MSEC_PER_SEC / PERIOD_MS;
+	snap->pool_min = payload_free_min(true);
+	snap->errors = errors - m_mark_errors;
+	bt_conn_foreach(BT_CONN_TYPE_LE, conn_cb, snap);
+
+#if defined(HEAP_STATS)
+	if (sys_heap_runtime_stats_get(&_system_heap.heap, &heap) == 0) {
+		snap->heap_used = heap.allocated_bytes;
+		snap->heap_max = heap.max_allocated_bytes;
+	}
+#endif
+	if (m_snap_cnt == 0) {
+		m_heap_first = snap->heap_used;
+	}
+
+	snap->flags = flags_of(snap);
+	if (snap->flags & ~SOAK_FLAG_NO_CONN) {
+		m_anomaly_cnt++;
+		printk("Soak anomaly 0x%02x at %u s: %u B/s, %u errors\n",
+		       snap->flags, snap->uptime_s, snap->goodput, snap->errors);
+	}
+
+	m_mark_bytes = acked;
+	m_mark_errors = errors;
+	m_snap_cnt++;
+
+	k_work_schedule(&m_snapshot_work, K_MSEC(PERIOD_MS));
+}
+
+static int soak_init(void)
+{
+	if (PERIOD_MS == 0) {
+		return 0;
+	}
+	k_work_schedule(&m_snapshot_work, K_MSEC(PERIOD_MS));
+
+	return 0;
+}
+
+SYS_INIT(soak_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+static int cmd_soak(const struct shell *sh, size_t argc, char **argv)
+{
+	const uint32_t first = m_snap_cnt > RING_SIZE ? m_snap_cnt - RING_SIZE : 0;
+
+	shell_print(sh, "%u snapshots, %u anomalies, baseline %llu B/s",
+	            m_snap_cnt, m_anomaly_cnt,
+	            m_baseline_cnt ? m_baseline_sum / m_baseline_cnt : 0);
+	shell_print(sh, "uptime_s,goodput_Bps,errors,conns,pool_min,"
+	            "heap_used,heap_max,flags");
+
+	for (uint32_t i = first; i < m_snap_cnt; i++) {
+		const struct soak_snapshot *snap = &m_ring[i % RING_SIZE];
+
+		shell_print(sh, "%u,%u,%u,%u,%u,%u,%u,0x%02x", snap->uptime_s,
+		            snap->goodput, snap->errors, snap->conn_cnt,
+		            snap->pool_min, snap->heap_used, snap->heap_max,
+		            snap->flags);
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), soak, NULL,
+                 "Print the periodic soak snapshots", cmd_soak, 1, 0);
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+#include "link_proc.h"
+#include "steady.h"
+#include "stream.h"
+
+#define PERIOD_MS CONFIG_THROUGHPUT_STEADY_PERIOD_MS
+#define WINDOW    CONFIG_THROUGHPUT_STEADY_WINDOW
+#define CV_PCT    CONFIG_THROUGHPUT_STEADY_CV_PCT
+
+/* Two-sided 95 % Student t quantiles * 1000 for 1 to 30 degrees of
+ * freedom, the normal quantile beyond.
+ */
+static const uint16_t t95[] = {
+	12706, 4303, 3182, 2776, 2571, 2447, 2365, 2306, 2262, 2228,
+	2201, 2179, 2160, 2145, 2131, 2120, 2110, 2101, 2093, 2086,
+	2080, 2074, 2069, 2064, 2060, 2056, 2052, 2048, 2045, 2042,
+};
+#define T95_INF 1960
+
+/* Sums of goodput samples in B/s, enough for mean and variance */
+struct sample_sums {
+	uint32_t n;
+	uint64_t sum;
+	uint64_t sum_sq;
+};
+
+struct steady {
+	struct bt_conn *conn;
+	struct k_work_delayable work;
+	int64_t connected_ms;
+	int64_t mtu_ms;         /* Uptime of the MTU exchange, 0 before */
+	int64_t change_ms;      /* Last link change or stream start */
+	uint64_t last_acked;
+	uint32_t window[WINDOW];
+	size_t window_cnt;
+	bool steady;
+	int64_t ramp_ms;        /* Change to steady state, -1 until reached */
+	struct sample_sums sums;  /* Since steady state was reached */
+};
+
+static struct steady m_steady[CONFIG_BT_MAX_CONN];
+
+static void sums_add(struct sample_sums *s, uint32_t val)
+{
+	s->n++;
+	s->sum += val;
+	s->sum_sq += (uint64_t)val * val;
+}
+
+static uint64_t sums_mean(const struct sample_sums *s)
+{
+	return s->n ? s->sum / s->n : 0;
+}
+
+// Sample variance, without squaring the sum so it cannot overflow
+static uint64_t sums_var(const struct sample_sums *s)
+{
+	const uint64_t sq = s->sum * sums_mean(s);
+
+	return s->n > 1 && s->sum_sq > sq ? (s->sum_sq - sq) / (s->n - 1) : 0;
+}
+
+static uint32_t isqrt(uint64_t val)
+{
+	uint64_t res = 0;
+	uint64_t bit = 1ULL << 62;
+
+	while (bit > val) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (val >= res + bit) {
+			val -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return res;
+}
+
+// Half width of the 95 % confidence interval of the mean. Samples are
+// taken as independent, which holds once the period is well above the
+// connection interval.
+static uint32_t sums_ci95(const struct sample_sums *s)
+{
+	uint32_t t;
+
+	if (s->n < 2) {
+		return 0;
+	}
+
+	t = s->n - 1 <= ARRAY_SIZE(t95) ? t95[s->n - 2] : T95_INF;
+
+	return (uint64_t)t * isqrt(sums_var(s) / s->n) / 1000;
+}
+
+static int64_t last_change(const struct steady *st)
+{
+	struct link_proc_stats stats;
+	int64_t latest = st->mtu_ms;
+
+	for (size_t t = 0; t < LINK_PROC_COUNT; t++) {
+		link_proc_stats_get(st->conn, t, &stats);
+		latest = MAX(latest, stats.done_at);
+	}
+
+	return latest;
+}
+
+static void ramp_restart(struct steady *st, int64_t at)
+{
+	st->change_ms = at;
+	st->window_cnt = 0;
+	st->steady = false;
+}
+
+// Steady once the coefficient of variation over a full window is small
+static bool window_steady(const struct steady *st)
+{
+	struct sample_sums w = { 0 };
+
+	for (size_t i = 0; i < WINDOW; i++) {
+		sums_add(&w, st->window[i]);
+	}
+
+	return sums_mean(&w) &&
+	       sums_var(&w) * 100 * 100 <=
+	       (uint64_t)CV_PCT * CV_PCT * sums_mean(&w) * sums_mean(&w);
+}
+
+static void sample_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct steady *st = CONTAINER_OF(dwork, struct steady, work);
+	const int64_t now = k_uptime_get();
+	struct stream_stats stats;
+	int64_t change;
+	uint32_t goodput;
+
+	if (!st->conn) {
+		return;
+	}
+
+	stream_stats_get(st->conn, &stats);
+	goodput = (stats.bytes_acked - st->last_acked) * MSEC_PER_SEC / PERIOD_MS;
+	st->last_acked = stats.bytes_acked;
+
+	change = last_change(st);
+	if (goodput == 0) {
+		/* Not streaming, the ramp starts with the stream */
+		ramp_restart(st, now);
+	} else if (change > st->change_ms) {
+		ramp_restart(st, change);
+	} else if (st->steady) {
+		sums_add(&st->sums, goodput);
+	} else {
+		memmove(&st->window[1], &st->window[0],
+		        sizeof(st->window) - sizeof(st->window[0]));
+		st->window[0] = goodput;
+		st->window_cnt = MIN(st->window_cnt + 1, WINDOW);
+
+		if (st->window_cnt == WINDOW && window_steady(st)) {
+			/* The window is the first part of the steady state */
+			st->steady = true;
+			st->ramp_ms = MAX(now - WINDOW * PERIOD_MS - st->change_ms, 0);
+			memset(&st->sums, 0, sizeof(st->sums));
+			for (size_t i = 0; i < WINDOW; i++) {
+				sums_add(&st->sums, st->window[i]);
+			}
+			printk("Steady state after %lld ms ramp-up, %llu B/s\n",
+			       st->ramp_ms, sums_mean(&st->sums));
+		}
+	}
+
+	k_work_schedule(&st->work, K_MSEC(PERIOD_MS));
+}
+
+void steady_connected(struct bt_conn *conn)
+{
+	struct steady *st = &m_steady[bt_conn_index(conn)];
+
+	memset(st, 0, sizeof(*st));
+	k_work_init_delayable(&st->work, sample_work_handler);
+	st->connected_ms = k_uptime_get();
+	st->change_ms = st->connected_ms;
+	st->ramp_ms = -1;
+	st->conn = bt_conn_ref(conn);
+	k_work_schedule(&st->work, K_MSEC(PERIOD_MS));
+}
+
+void steady_disconnected(struct bt_conn *conn)
+{
+	struct steady *st = &m_steady[bt_conn_index(conn)];
+
+	if (st->conn != conn) {
+		return;
+	}
+	st->conn = NULL;
+	k_work_cancel_delayable(&st->work);
+	bt_conn_unref(conn);
+}
+
+void steady_mtu_updated(struct bt_conn *conn)
+{
+	m_steady[bt_conn_index(conn)].mtu_ms = k_uptime_get();
+}
+
+static int cmd_steady(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char * const proc_name[LINK_PROC_COUNT] = {
+		[LINK_PROC_PHY] = "phy",
+		[LINK_PROC_DATA_LEN] = "data len",
+		[LINK_PROC_CONN_PARAM] = "conn param",
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(m_steady); i++) {
+		const struct steady *st = &m_steady[i];
+		struct link_proc_stats stats;
+
+		if (!st->conn) {
+			continue;
+		}
+
+		shell_print(sh, "conn %u", i);
+		shell_print(sh, "  %-10s %lld ms after connect", "mtu",
+		            st->mtu_ms ? st->mtu_ms - st->connected_ms : -1);
+		for (size_t t = 0; t < LINK_PROC_COUNT; t++) {
+			link_proc_stats_get(st->conn, t, &stats);
+			shell_print(sh, "  %-10s %lld ms after connect",
+			            proc_name[t],
+			            stats.done_at ? stats.done_at - st->connected_ms :
+			                            -1);
+		}
+
+		if (st->ramp_ms < 0) {
+			shell_print(sh, "  no steady state yet");
+			continue;
+		}
+		shell_print(sh, "  %s: ramp-up %lld ms, %u samples, "
+		            "%llu +/- %u B/s (95 %% CI)",
+		            st->steady ? "steady" : "last steady",
+		            st->ramp_ms, st->sums.n, sums_mean(&st->sums),
+		            sums_ci95(&st->sums));
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), steady, NULL,
+                 "Print link procedure completion times, ramp-up duration "
+                 "and steady state goodput", cmd_steady, 1, 0);
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_STEADY_H_
+#define THROUGHPUT_STEADY_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * @brief Start sampling goodput of a new connection.
+ *
+ * @param conn New connection.
+ */
+void steady_connected(struct bt_conn *conn);
+
+/**
+ * @brief Stop sampling a connection.
+ *
+ * @param conn Connection that went away.
+ */
+void steady_disconnected(struct bt_conn *conn);
+
+/**
+ * @brief Record completion of the ATT MTU exchange.
+ *
+ * Link layer procedures are timestamped by link_proc.c, the MTU exchange
+ * is driven by the central and has to be reported separately.
+ *
+ * @param conn Connection.
+ */
+void steady_mtu_updated(struct bt_conn *conn);
+
+#endif /* THROUGHPUT_STEADY_H_ */
@@ -0,0 +1,483 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "boot.h"
+#include "load.h"
+#include "matrix.h"
+#include "stream.h"
+#include "transport.h"
+
+/* Initial and maximum time to wait for a TX completion after -ENOMEM */
+#define TX_WAIT_MIN_MS 10
+#define TX_WAIT_MAX_MS 320
+
+/* The completion context carries the fragment length, the generation of
+ * the link it was sent on and the time it was queued, in units of 8 us
+ * modulo 2^20 (~8.4 s).
+ */
+#define CTX_LEN_BITS 9
+#define CTX_GEN_BITS 3
+#define CTX_TS_SHIFT (CTX_LEN_BITS + CTX_GEN_BITS)
+#define CTX_TS_MASK  BIT_MASK(32 - CTX_TS_SHIFT)
+#define CTX_TS_UNIT  3
+
+BUILD_ASSERT(CONFIG_BT_L2CAP_TX_MTU - MTU_OVERHEAD < BIT(CTX_LEN_BITS),
+             "Fragment length does not fit the completion context");
+
+BUILD_ASSERT(BULK_CREDITS > 0, "No TX buffers left for bulk data");
+
+/* TX buffers are shared by all links, so any completion may unblock a sender */
+static K_SEM_DEFINE(tx_done_sem, 0, 1);
+/* Bulk notifications in flight on all links */
+static atomic_t m_in_flight_total;
+/* Ties in-flight counts to the link generation they belong to */
+static struct k_spinlock m_lock;
+
+static struct stream_ctx {
+	struct stream_stats stats;
+	/* Counters at the last "throughput stats reset". The counters
+	 * themselves only restart with the connection, other modules take
+	 * deltas of them.
+	 */
+	struct stream_stats shown_base;
+	uint32_t wait_ms;
+	int64_t connected_ms;
+	atomic_t in_flight;
+	uint8_t gen;         /* Bumped whenever the link goes away */
+	struct log2_hist delay_us;
+	/* Congestion window, see stream_window_set() */
+	atomic_t window;
+	uint16_t acked;      /* Completions since the last increase */
+	uint16_t hold;       /* Completions left before the next decrease */
+	uint32_t increases;
+	uint32_t decreases;
+} m_ctx[CONFIG_BT_MAX_CONN];
+
+static enum stream_window_mode m_window_mode = STREAM_WINDOW_FIXED;
+static uint32_t m_window_fixed = BULK_CREDITS;
+static uint32_t m_window_target_us = CONFIG_THROUGHPUT_WINDOW_TARGET_US;
+
+/* Never reset, unlike the per-connection counters */
+static uint64_t m_acked_total;
+static uint32_t m_notifications_total;
+static uint32_t m_errors_total;
+
+static struct stream_ctx *ctx_of(const struct bt_conn *conn)
+{
+	return &m_ctx[bt_conn_index(conn)];
+}
+
+static uint32_t now_ts(void)
+{
+	return (k_cyc_to_us_floor64(k_cycle_get_64()) >> CTX_TS_UNIT) &
+	       CTX_TS_MASK;
+}
+
+static uint8_t slot_take(struct stream_ctx *ctx)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+	const uint8_t gen = ctx->gen;
+
+	atomic_inc(&ctx->in_flight);
+	atomic_inc(&m_in_flight_total);
+	k_spin_unlock(&m_lock, key);
+
+	return gen;
+}
+
+// Returns -ESTALE if the slot was taken on a link that has gone since,
+// whose credits were already returned, otherwise what is left in flight
+static int slot_return(struct stream_ctx *ctx, uint8_t gen)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+	int left = -ESTALE;
+
+	if (gen == ctx->gen) {
+		left = atomic_dec(&ctx->in_flight) - 1;
+		atomic_dec(&m_in_flight_total);
+	}
+	k_spin_unlock(&m_lock, key);
+
+	return left;
+}
+
+// Give back the credits of notifications whose completion may never come
+static void slots_release(struct stream_ctx *ctx)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	ctx->gen = (ctx->gen + 1) & BIT_MASK(CTX_GEN_BITS);
+	atomic_sub(&m_in_flight_total, atomic_clear(&ctx->in_flight));
+	k_spin_unlock(&m_lock, key);
+
+	k_sem_give(&tx_done_sem);
+}
+
+// Delay-based AIMD, from the completion path of every bulk notification
+static void window_update(struct stream_ctx *ctx, uint32_t latency_us)
+{
+	atomic_val_t window = atomic_get(&ctx->window);
+
+	if (ctx->hold) {
+		ctx->hold--;
+	}
+
+	if (latency_us > m_window_target_us) {
+		ctx->acked = 0;
+		if (ctx->hold == 0) {
+			/* Notifications sent at the old window still drain */
+			window = MAX(window / 2, 1);
+			ctx->hold = atomic_get(&ctx->in_flight);
+			ctx->decreases++;
+		}
+	} else if (++ctx->acked >= window) {
+		ctx->acked = 0;
+		if (window < BULK_CREDITS) {
+			window++;
+			ctx->increases++;
+		}
+	}
+
+	atomic_set(&ctx->window, window);
+}
+
+static void window_reset(struct stream_ctx *ctx)
+{
+	atomic_set(&ctx->window, m_window_mode == STREAM_WINDOW_AIMD ?
+	                         1 : m_window_fixed);
+	ctx->acked = 0;
+	ctx->hold = 0;
+}
+
+static void tx_done(struct bt_conn *conn, void *user_data)
+{
+	struct stream_ctx *ctx = ctx_of(conn);
+	const uint32_t packed = POINTER_TO_UINT(user_data);
+	const uint16_t len = packed & BIT_MASK(CTX_LEN_BITS);
+	const uint8_t gen = (packed >> CTX_LEN_BITS) & BIT_MASK(CTX_GEN_BITS);
+	const int left = slot_return(ctx, gen);
+
+	if (left < 0) {
+		return;
+	}
+
+	if (ctx->stats.bytes_acked == 0) {
+		// Includes service discovery, which GATT caching lets bonded
+		// centrals skip
+		ctx->stats.first_notify_ms = k_uptime_get() - ctx->connected_ms;
+		printk("First notification %lld ms after connection\n",
+		       ctx->stats.first_notify_ms);
+	}
+	// The sender did not top up the queue before it ran dry
+	if (left == 0) {
+		ctx->stats.tx_drained++;
+	}
+	ctx->stats.bytes_acked += len;
+	m_acked_total += len;
+	if (IS_ENABLED(CONFIG_THROUGHPUT_INSTRUMENT)) {
+		const uint32_t latency_us =
+			((now_ts() - (packed >> CTX_TS_SHIFT)) & CTX_TS_MASK) <<
+			CTX_TS_UNIT;
+
+		hist_add(&ctx->delay_us, latency_us);
+		if (m_window_mode == STREAM_WINDOW_AIMD) {
+			window_update(ctx, latency_us);
+		}
+		matrix_record(conn, len, latency_us);
+		load_record(len, latency_us);
+	}
+	boot_mark(BOOT_FIRST_NOTIFY);
+	k_sem_give(&tx_done_sem);
+}
+
+static void count_error(struct stream_stats *stats, int err)
+{
+	if (err != -ENOMEM) {
+		m_errors_total++;
+	}
+	stats->last_err = err;
+	switch (err) {
+	case -ENOMEM:
+		stats->err_nomem++;
+		break;
+	case -ENOTCONN:
+		stats->err_notconn++;
+		break;
+	default:
+		stats->err_other++;
+		break;
+	}
+}
+
+// Write to the notification characteristic fragmenting at MTU as quickly as possible
+int stream_send(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                const void *data, uint16_t len, uint16_t mtu,
+                uint16_t *offset)
+{
+	if (conn == NULL) {
+		return -ENODEV;
+	}
+
+	struct stream_ctx *ctx = ctx_of(conn);
+	/* A constant lets the compiler drop the fragment arithmetic */
+	const uint16_t max_frag = CONFIG_THROUGHPUT_FIXED_MTU ?
+	                          CONFIG_THROUGHPUT_FIXED_MTU - MTU_OVERHEAD :
+	                          mtu - MTU_OVERHEAD;
+
+	while (*offset < len) {
+		const uint16_t frag_len = MIN(len - *offset, max_frag);
+		const uint8_t *frag = (const uint8_t *)data + *offset;
+		/* Timestamps cost a 64-bit division per notification */
+		const uint32_t ts = IS_ENABLED(CONFIG_THROUGHPUT_INSTRUMENT) ?
+		                    now_ts() : 0;
+
+		if (atomic_get(&m_in_flight_total) >= BULK_CREDITS ||
+		    atomic_get(&ctx->in_flight) >= atomic_get(&ctx->window)) {
+			/* Our own limit, the host was not asked */
+			ctx->stats.window_waits++;
+		} else {
+			/* Reserved up front, the completion may run before
+			 * transport_notify() returns
+			 */
+			const uint8_t gen = slot_take(ctx);
+			const int err = transport_notify(
+				conn, attr, frag, frag_len, tx_done,
+				UINT_TO_POINTER(ts << CTX_TS_SHIFT |
+				                gen << CTX_LEN_BITS | frag_len));
+
+			if (err == 0) {
+				*offset += frag_len;
+				ctx->stats.notifications++;
+				m_notifications_total++;
+				ctx->stats.bytes_sent += frag_len;
+				ctx->wait_ms = TX_WAIT_MIN_MS;
+				continue;
+			}
+
+			slot_return(ctx, gen);
+			count_error(&ctx->stats, err);
+			if (err != -ENOMEM) {
+				/* -ENOTCONN and anything unexpected go back to
+				 * the caller, which keeps the buffer and the
+				 * offset.
+				 */
+				return err;
+			}
+			ctx->stats.retries++;
+		}
+
+		/* Out of TX buffers: block until one is released instead of
+		 * spinning. If none is released in time, back off and let the
+		 * caller service other links before retrying this one.
+		 */
+		if (k_sem_take(&tx_done_sem, K_MSEC(ctx->wait_ms)) != 0) {
+			ctx->stats.tx_wait_timeouts++;
+			ctx->wait_ms = MIN(ctx->wait_ms << 1, TX_WAIT_MAX_MS);
+			return -EAGAIN;
+		}
+	}
+
+	return 0;
+}
+
+void stream_reset(const struct bt_conn *conn)
+{
+	struct stream_ctx *ctx = ctx_of(conn);
+
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	memset(&ctx->shown_base, 0, sizeof(ctx->shown_base));
+	memset(&ctx->delay_us, 0, sizeof(ctx->delay_us));
+	ctx->wait_ms = TX_WAIT_MIN_MS;
+	ctx->connected_ms = k_uptime_get();
+	slots_release(ctx);
+	window_reset(ctx);
+	ctx->increases = 0;
+	ctx->decreases = 0;
+}
+
+void stream_disconnected(const struct bt_conn *conn)
+{
+	slots_release(ctx_of(conn));
+}
+
+void stream_stats_get(const struct bt_conn *conn, struct stream_stats *stats)
+{
+	*stats = ctx_of(conn)->stats;
+}
+
+uint32_t stream_in_flight(const struct bt_conn *conn)
+{
+	return atomic_get(&ctx_of(conn)->in_flight);
+}
+
+int stream_window_set(enum stream_window_mode mode, uint32_t arg)
+{
+	switch (mode) {
+	case STREAM_WINDOW_FIXED:
+		if (arg < 1 || arg > BULK_CREDITS) {
+			return -EINVAL;
+		}
+		m_window_fixed = arg;
+		break;
+	case STREAM_WINDOW_AIMD:
+		if (!IS_ENABLED(CONFIG_THROUGHPUT_INSTRUMENT)) {
+			return -ENOTSUP;
+		}
+		if (arg == 0) {
+			return -EINVAL;
+		}
+		m_window_target_us = arg;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	m_window_mode = mode;
+	for (size_t i = 0; i < ARRAY_SIZE(m_ctx); i++) {
+		window_reset(&m_ctx[i]);
+	}
+
+	return 0;
+}
+
+void stream_delay_get(const struct bt_conn *conn, struct log2_hist *hist)
+{
+	*hist = ctx_of(conn)->delay_us;
+}
+
+int stream_tx_wait(k_timeout_t timeout)
+{
+	return k_sem_take(&tx_done_sem, timeout);
+}
+
+uint64_t stream_bytes_acked_total(void)
+{
+	return m_acked_total;
+}
+
+uint32_t stream_notifications_total(void)
+{
+	return m_notifications_total;
+}
+
+uint32_t stream_errors_total(void)
+{
+	return m_errors_total;
+}
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_ctx); i++) {
+		const struct stream_stats *stats = &m_ctx[i].stats;
+		struct stream_stats *base = &m_ctx[i].shown_base;
+
+#define SHOWN(field) (stats->field - base->field)
+		shell_print(sh, "conn %u", i);
+		shell_print(sh, "  first notify:     %lld ms after connect",
+		            stats->first_notify_ms);
+		shell_print(sh, "  notifications:    %u", SHOWN(notifications));
+		shell_print(sh, "  bytes sent:       %llu", SHOWN(bytes_sent));
+		shell_print(sh, "  bytes acked:      %llu", SHOWN(bytes_acked));
+		shell_print(sh, "  retries:          %u", SHOWN(retries));
+		shell_print(sh, "  window waits:     %u", SHOWN(window_waits));
+		shell_print(sh, "  tx wait timeouts: %u",
+		            SHOWN(tx_wait_timeouts));
+		shell_print(sh, "  tx queue drained: %u", SHOWN(tx_drained));
+		shell_print(sh, "  -ENOMEM:          %u", SHOWN(err_nomem));
+		shell_print(sh, "  -ENOTCONN:        %u", SHOWN(err_notconn));
+		shell_print(sh, "  other errors:     %u (last %d)",
+		            SHOWN(err_other), stats->last_err);
+#undef SHOWN
+
+		if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+			*base = *stats;
+		}
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), stats, NULL,
+                 "Print per-connection send path counters [reset]",
+                 cmd_stats, 1, 1);
+
+static int cmd_delay(const struct shell *sh, size_t argc, char **argv)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_ctx); i++) {
+		struct log2_hist *hist = &m_ctx[i].delay_us;
+
+		shell_print(sh, "conn %u: %u notifications, p50 %u us, "
+		            "p90 %u us, p99 %u us, in flight %d", i, hist->count,
+		            hist_percentile(hist, 50), hist_percentile(hist, 90),
+		            hist_percentile(hist, 99),
+		            (int)atomic_get(&m_ctx[i].in_flight));
+		for (size_t b = 0; b < HIST_BUCKETS; b++) {
+			if (hist->bucket[b]) {
+				shell_print(sh, "  <= %8u us: %u",
+				            hist_bucket_max(b), hist->bucket[b]);
+			}
+		}
+
+		if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+			memset(hist, 0, sizeof(*hist));
+		}
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), delay, NULL,
+                 "Print the per-connection queueing delay histogram from "
+                 "notify call to completion [reset]", cmd_delay, 1, 1);
+
+static int cmd_window(const struct shell *sh, size_t argc, char **argv)
+{
+	int err = 0;
+
+	if (argc > 2 && strcmp(argv[1], "fixed") == 0) {
+		err = stream_window_set(STREAM_WINDOW_FIXED,
+		                        strtoul(argv[2], NULL, 0));
+	} else if (argc > 1 && strcmp(argv[1], "aimd") == 0) {
+		err = stream_window_set(STREAM_WINDOW_AIMD,
+		                        argc > 2 ? strtoul(argv[2], NULL, 0) :
+		                                   CONFIG_THROUGHPUT_WINDOW_TARGET_US);
+	} else if (argc > 1) {
+		shell_help(sh);
+		return -EINVAL;
+	}
+	if (err) {
+		shell_error(sh, "Failed to set window (err %d)", err);
+		return err;
+	}
+
+	if (m_window_mode == STREAM_WINDOW_AIMD) {
+		shell_print(sh, "aimd, target %u us", m_window_target_us);
+	} else {
+		shell_print(sh, "fixed, %u of %u buffers", m_window_fixed,
+		            BULK_CREDITS);
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(m_ctx); i++) {
+		const struct stream_ctx *ctx = &m_ctx[i];
+
+		shell_print(sh, "conn %u: window %d, in flight %d, "
+		            "increases %u, decreases %u", i,
+		            (int)atomic_get(&ctx->window),
+		            (int)atomic_get(&ctx->in_flight),
+		            ctx->increases, ctx->decreases);
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), window, NULL,
+                 "Limit notifications in flight per link [fixed <n>|"
+                 "aimd [target us]] or print the windows", cmd_window, 1, 2);
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_STREAM_H_
+#define THROUGHPUT_STREAM_H_
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include "hist.h"
+
+/* ATT opcode + attribute handle preceding every notification payload */
+#define MTU_OVERHEAD 3
+/* Handle and length of each value in a multiple handle value notification */
+#define NOTIFY_MULTI_OVERHEAD 4
+
+/* TX buffers left to bulk notifications by the control lane, see ctrl.c */
+#define BULK_CREDITS (CONFIG_BT_BUF_ACL_TX_COUNT - CONFIG_THROUGHPUT_CTRL_CREDITS)
+
+/** @brief How the number of notifications in flight per link is limited. */
+enum stream_window_mode {
+	STREAM_WINDOW_FIXED, /* Constant window */
+	STREAM_WINDOW_AIMD,  /* Adapted to keep queueing delay below a target */
+};
+
+/** @brief Send path counters. */
+struct stream_stats {
+	uint32_t notifications;
+	uint64_t bytes_sent;
+	uint64_t bytes_acked;
+	uint32_t retries;        /* Notifications retried after -ENOMEM */
+	uint32_t window_waits;   /* Waits for the window or bulk credits */
+	uint32_t tx_wait_timeouts;
+	uint32_t tx_drained;     /* Completions that left nothing in flight */
+	uint32_t err_nomem;      /* From the host only */
+	uint32_t err_notconn;
+	uint32_t err_other;
+	int last_err;
+	int64_t first_notify_ms; /* From connection to first completion */
+};
+
+/**
+ * @brief Notify a buffer, fragmenting it at the ATT MTU.
+ *
+ * Sending starts at @p offset, which is advanced past every fragment that
+ * was accepted. When the host runs out of TX buffers (-ENOMEM), or the
+ * link's window or the bulk data's TX buffers are all in flight, the call
+ * blocks until a previous notification completes and retries the same
+ * fragment, so no data is dropped. If no completion arrives within the
+ * connection's current back-off time, -EAGAIN is returned so the caller
+ * can service other links. Any other error is returned as well; in every
+ * case @p offset points at the fragment that has to be sent next.
+ *
+ * @param conn   Connection to notify.
+ * @param attr   Characteristic value attribute.
+ * @param data   Payload.
+ * @param len    Payload length, may exceed a single notification.
+ * @param mtu    ATT MTU used to size fragments.
+ * @param offset In: first byte to send. Out: first byte not yet sent.
+ *
+ * @return 0 once the whole buffer is sent, -ENODEV without a connection,
+ *         -EAGAIN while TX buffers stay exhausted, -ENOTCONN if the link
+ *         went away or another transport error.
+ */
+int stream_send(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+		const void *data, uint16_t len, uint16_t mtu,
+		uint16_t *offset);
+
+/**
+ * @brief Clear the send state and counters of a new connection.
+ *
+ * Also starts the timer for the connection-to-first-notification delay.
+ *
+ * @param conn Connection.
+ */
+void stream_reset(const struct bt_conn *conn);
+
+/**
+ * @brief Get a snapshot of a connection's send path counters.
+ *
+ * The counters restart only with stream_reset(), "throughput stats reset"
+ * leaves them alone, so callers may take deltas across calls.
+ *
+ * @param conn  Connection.
+ * @param stats Destination.
+ */
+void stream_stats_get(const struct bt_conn *conn, struct stream_stats *stats);
+
+/**
+ * @brief Number of bulk notifications of a connection not yet completed.
+ *
+ * @param conn Connection.
+ *
+ * @return Notifications in flight.
+ */
+uint32_t stream_in_flight(const struct bt_conn *conn);
+
+/**
+ * @brief Return the TX credits still held by a connection that went away.
+ *
+ * Completions of notifications sent before are ignored from then on.
+ *
+ * @param conn Connection that went away.
+ */
+void stream_disconnected(const struct bt_conn *conn);
+
+/**
+ * @brief Get the queueing delay histogram of a connection.
+ *
+ * Each sample is the time from handing a notification to the host until
+ * its completion callback, in microseconds. Recorded only with
+ * CONFIG_THROUGHPUT_INSTRUMENT.
+ *
+ * @param conn Connection.
+ * @param hist Destination.
+ */
+void stream_delay_get(const struct bt_conn *conn, struct log2_hist *hist);
+
+/**
+ * @brief Select how notifications in flight are limited on every link.
+ *
+ * In AIMD mode each link starts from one notification in flight, grows
+ * its window by one per window of completions whose queueing delay is
+ * below the target, and halves it at most once per window otherwise.
+ * Delay is only measured with CONFIG_THROUGHPUT_INSTRUMENT.
+ *
+ * @param mode Window mode.
+ * @param arg  Window size for STREAM_WINDOW_FIXED, 1 to BULK_CREDITS, or
+ *             target queueing delay in microseconds for STREAM_WINDOW_AIMD.
+ *
+ * @return 0 on success, -EINVAL for an invalid argument or -ENOTSUP for
+ *         AIMD without instrumentation.
+ */
+int stream_window_set(enum stream_window_mode mode, uint32_t arg);
+
+/**
+ * @brief Wait for any notification to complete.
+ *
+ * @param timeout Longest time to wait.
+ *
+ * @return 0 after a completion, -EAGAIN on timeout.
+ */
+int stream_tx_wait(k_timeout_t timeout);
+
+/** @brief Bytes acknowledged on all connections since boot. */
+uint64_t stream_bytes_acked_total(void);
+
+/** @brief Notifications accepted on all connections since boot. */
+uint32_t stream_notifications_total(void);
+
+/** @brief Send errors other than -ENOMEM on all connections since boot. */
+uint32_t stream_errors_total(void);
+
+#endif /* THROUGHPUT_STREAM_H_ */
@@ -0,0 +1,448 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link_proc.h"
+#include "main.h"
+#include "profile.h"
+#include "stream.h"
+
+#define LIST_MAX 8
+/* Longest wait for all links to finish their procedures */
+#define SETTLE_TIMEOUT_MS 10000
+#define SETTLE_POLL_MS    20
+/* L2CAP basic header + ATT notification header */
+#define PDU_OVERHEAD (4 + MTU_OVERHEAD)
+/* Smallest payload of the size curve */
+#define CURVE_MIN 20
+/* Connection interval range, 1.25 ms units */
+#define INTERVAL_MIN 6
+#define INTERVAL_MAX 3200
+/* Supervision timeout range used, 10 ms units */
+#define TIMEOUT_MIN 400
+#define TIMEOUT_MAX 3200
+/* Connection events the link survives missing */
+#define TIMEOUT_EVENTS 6
+
+static const struct {
+	const char *name;
+	uint8_t phy;
+	uint8_t options;
+} m_phys[] = {
+	{ "1m", BT_GAP_LE_PHY_1M, BT_CONN_LE_PHY_OPT_NONE },
+	{ "2m", BT_GAP_LE_PHY_2M, BT_CONN_LE_PHY_OPT_NONE },
+	{ "s2", BT_GAP_LE_PHY_CODED, BT_CONN_LE_PHY_OPT_CODED_S2 },
+	{ "s8", BT_GAP_LE_PHY_CODED, BT_CONN_LE_PHY_OPT_CODED_S8 },
+};
+
+struct sweep_list {
+	uint16_t val[LIST_MAX];
+	size_t cnt;
+};
+
+/* One combination, m_phys index in phy */
+struct sweep_point {
+	uint16_t interval;
+	uint16_t phy;
+	uint16_t data_len;
+	uint16_t mtu;
+};
+
+/* State of the links after a change, from the first connection */
+struct sweep_link {
+	size_t conn_cnt;
+	size_t busy_cnt;
+	struct bt_conn_info info;
+	uint16_t mtu;
+};
+
+/* Totals over the timed window of one measurement */
+struct sweep_result {
+	uint64_t bytes;
+	uint32_t errors;
+	uint64_t busy;    /* Non-idle cycles */
+	uint64_t cycles;  /* All cycles */
+};
+
+static int phy_parse(const char *tok)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_phys); i++) {
+		if (strcmp(tok, m_phys[i].name) == 0) {
+			return i;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int list_parse(const struct shell *sh, char *arg, bool phy,
+                      struct sweep_list *list)
+{
+	char *save;
+
+	list->cnt = 0;
+	for (char *tok = strtok_r(arg, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		const long val = phy ? phy_parse(tok) : strtol(tok, NULL, 0);
+
+		if (list->cnt == LIST_MAX || val < 0 || val > UINT16_MAX) {
+			shell_error(sh, "Invalid list entry %s", tok);
+			return -EINVAL;
+		}
+		list->val[list->cnt++] = val;
+	}
+
+	return list->cnt ? 0 : -EINVAL;
+}
+
+// The timeout has to exceed (1 + latency) * interval * 2, and is kept at
+// 4 s or more so short intervals do not drop the link on brief fades
+static uint16_t timeout_of(uint16_t interval, uint16_t latency)
+{
+	const uint32_t timeout = DIV_ROUND_UP((1U + latency) * interval * 125U *
+	                                      TIMEOUT_EVENTS, 1000U);
+
+	return CLAMP(timeout, TIMEOUT_MIN, TIMEOUT_MAX);
+}
+
+BUILD_ASSERT(INTERVAL_MAX * 125U * TIMEOUT_EVENTS / 1000U <= TIMEOUT_MAX,
+             "Supervision timeout too long for the longest interval");
+
+static void apply_cb(struct bt_conn *conn, void *data)
+{
+	const struct sweep_point *p = data;
+	const struct bt_le_conn_param conn_param =
+		BT_LE_CONN_PARAM_INIT(p->interval, p->interval, 0,
+		                      timeout_of(p->interval, 0));
+	const struct bt_conn_le_phy_param phy = {
+		.options = m_phys[p->phy].options,
+		.pref_tx_phy = m_phys[p->phy].phy,
+		.pref_rx_phy = m_phys[p->phy].phy,
+	};
+	const struct bt_conn_le_data_len_param data_len = {
+		.tx_max_len = p->data_len,
+		.tx_max_time = BT_GAP_DATA_TIME_MAX,
+	};
+
+	link_stream(conn, false);
+	link_payload_cap(conn, p->mtu - MTU_OVERHEAD);
+	link_proc_conn_param(conn, &conn_param);
+	link_proc_phy(conn, &phy);
+	link_proc_data_len(conn, &data_len);
+}
+
+static void state_cb(struct bt_conn *conn, void *data)
+{
+	struct sweep_link *link = data;
+
+	if (!link_proc_idle(conn)) {
+		link->busy_cnt++;
+	}
+	if (link->conn_cnt++ == 0) {
+		bt_conn_get_info(conn, &link->info);
+		link->mtu = bt_gatt_get_mtu(conn);
+	}
+}
+
+static void stream_cb(struct bt_conn *conn, void *data)
+{
+	link_stream(conn, *(const bool *)data);
+}
+
+static void restore_cb(struct bt_conn *conn, void *data)
+{
+	link_stream(conn, false);
+	link_payload_cap(conn, 0);
+}
+
+static void stream_all(bool enable)
+{
+	bt_conn_foreach(BT_CONN_TYPE_LE, stream_cb, &enable);
+}
+
+// Timed part of a measurement, the links are streaming already
+static void measure_window(struct sweep_result *res)
+{
+	k_thread_runtime_stats_t start, end;
+
+	res->bytes = stream_bytes_acked_total();
+	res->errors = stream_errors_total();
+	k_thread_runtime_stats_all_get(&start);
+	k_msleep(CONFIG_THROUGHPUT_SWEEP_DURATION_S * MSEC_PER_SEC);
+	k_thread_runtime_stats_all_get(&end);
+	res->bytes = stream_bytes_acked_total() - res->bytes;
+	res->errors = stream_errors_total() - res->errors;
+
+	stream_all(false);
+
+	/* execution_cycles includes the idle thread, total_cycles does not */
+	res->cycles = end.execution_cycles - start.execution_cycles;
+	res->busy = end.total_cycles - start.total_cycles;
+}
+
+static void measure(struct sweep_result *res)
+{
+	stream_all(true);
+	k_msleep(CONFIG_THROUGHPUT_SWEEP_WARMUP_S * MSEC_PER_SEC);
+	measure_window(res);
+}
+
+// Renegotiate every link, then stream through the warm-up and the timed
+// window. Returns -ENOTCONN once the last central went away.
+static int sweep_run(const struct shell *sh, struct sweep_point *p)
+{
+	const uint32_t duration_ms = CONFIG_THROUGHPUT_SWEEP_DURATION_S *
+	                             MSEC_PER_SEC;
+	struct sweep_result res;
+	struct sweep_link link;
+	uint32_t payload, events, pdus;
+	int64_t settle_ms = 0;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, apply_cb, p);
+	do {
+		k_msleep(SETTLE_POLL_MS);
+		settle_ms += SETTLE_POLL_MS;
+		memset(&link, 0, sizeof(link));
+		bt_conn_foreach(BT_CONN_TYPE_LE, state_cb, &link);
+	} while (link.busy_cnt && settle_ms < SETTLE_TIMEOUT_MS);
+
+	if (!link.conn_cnt) {
+		return -ENOTCONN;
+	}
+
+	measure(&res);
+
+	/* Notifications are sized to the smaller of both MTUs */
+	payload = MIN(p->mtu, link.mtu) - MTU_OVERHEAD;
+	events = (uint64_t)duration_ms * USEC_PER_MSEC * link.conn_cnt /
+	         (link.info.le.interval * 1250U);
+	pdus = res.bytes / payload * DIV_ROUND_UP(payload + PDU_OVERHEAD,
+	                                      link.info.le.data_len->tx_max_len);
+
+	shell_print(sh, "%u,%s,%u,%u,%u,%u,%u,%u,%s,%llu,%u.%02u,%u,%u",
+	            p->interval, m_phys[p->phy].name, p->data_len, p->mtu,
+	            link.info.le.interval, link.info.le.phy->tx_phy,
+	            link.info.le.data_len->tx_max_len, link.mtu,
+	            link.busy_cnt ? "timeout" : "ok",
+	            res.bytes * MSEC_PER_SEC / duration_ms,
+	            events ? pdus / events : 0,
+	            events ? pdus * 100 / events % 100 : 0, res.errors,
+	            res.cycles ? (uint32_t)(res.busy * 100 / res.cycles) : 0);
+
+	return 0;
+}
+
+static int cmd_sweep(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sweep_list lists[4];
+	struct sweep_point p;
+	size_t total = 1;
+	int err = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(lists); i++) {
+		err = list_parse(sh, argv[i + 1], i == 1, &lists[i]);
+		if (err) {
+			return err;
+		}
+	}
+	for (size_t i = 0; i < lists[0].cnt; i++) {
+		if (lists[0].val[i] < INTERVAL_MIN ||
+		    lists[0].val[i] > INTERVAL_MAX) {
+			shell_error(sh, "Interval %u out of range %u..%u",
+			            lists[0].val[i], INTERVAL_MIN, INTERVAL_MAX);
+			return -EINVAL;
+		}
+	}
+
+	shell_print(sh, "interval,phy,data_len,mtu,link_interval,link_phy,"
+	            "link_data_len,link_mtu,settled,goodput_Bps,"
+	            "pdus_per_event,errors,cpu_pct");
+
+	for (size_t i = 0; i < ARRAY_SIZE(lists); i++) {
+		total *= lists[i].cnt;
+	}
+
+	// Last list varies fastest
+	for (size_t n = 0; n < total && !err; n++) {
+		size_t idx = n;
+		uint16_t val[ARRAY_SIZE(lists)];
+
+		for (size_t i = ARRAY_SIZE(lists); i-- > 0;) {
+			val[i] = lists[i].val[idx % lists[i].cnt];
+			idx /= lists[i].cnt;
+		}
+		p.interval = val[0];
+		p.phy = val[1];
+		p.data_len = val[2];
+		p.mtu = MAX(val[3], MTU_OVERHEAD + 1);
+		err = sweep_run(sh, &p);
+	}
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, restore_cb, NULL);
+	if (err) {
+		shell_error(sh, "No connection, sweep aborted");
+	}
+
+	return err;
+}
+
+SHELL_SUBCMD_ADD((throughput), sweep, NULL,
+                 "Stream over every combination of comma separated lists "
+                 "<intervals (1.25 ms)> <phys 1m|2m|s2|s8> <data lens> "
+                 "<mtus> and print one CSV row each", cmd_sweep, 5, 0);
+
+static void payload_max_cb(struct bt_conn *conn, void *data)
+{
+	uint16_t *max = data;
+
+	*max = MIN(*max, bt_gatt_get_mtu(conn) - MTU_OVERHEAD);
+	*max = MIN(*max, profile_payload_max(conn));
+	if (CONFIG_THROUGHPUT_FIXED_MTU) {
+		*max = MIN(*max, CONFIG_THROUGHPUT_FIXED_MTU - MTU_OVERHEAD);
+	}
+}
+
+static void cap_cb(struct bt_conn *conn, void *data)
+{
+	link_payload_cap(conn, *(const uint16_t *)data);
+}
+
+static int cmd_curve(const struct shell *sh, size_t argc, char **argv)
+{
+	const unsigned long step = argc > 1 ? strtoul(argv[1], NULL, 0) : 16;
+	const uint32_t duration_ms = CONFIG_THROUGHPUT_SWEEP_DURATION_S *
+	                             MSEC_PER_SEC;
+	struct sweep_result res;
+	uint16_t max = UINT16_MAX;
+	uint32_t len = CURVE_MIN;
+
+	if (step == 0) {
+		shell_error(sh, "Invalid step");
+		return -EINVAL;
+	}
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, payload_max_cb, &max);
+	if (max == UINT16_MAX) {
+		shell_error(sh, "No connection");
+		return -ENOTCONN;
+	}
+
+	shell_print(sh, "payload,goodput_Bps,notifications_per_s,cycles_per_byte");
+	while (true) {
+		uint16_t cur = MIN(len, max);
+
+		bt_conn_foreach(BT_CONN_TYPE_LE, cap_cb, &cur);
+		measure(&res);
+		shell_print(sh, "%u,%llu,%llu,%llu", cur,
+		            res.bytes * MSEC_PER_SEC / duration_ms,
+		            res.bytes / cur * MSEC_PER_SEC / duration_ms,
+		            res.bytes ? res.busy / res.bytes : 0);
+
+		if (cur >= max) {
+			break;
+		}
+		len += step;
+	}
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, restore_cb, NULL);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), curve, NULL,
+                 "Stream with payloads from 20 bytes to the negotiated "
+                 "maximum in [step] byte increments and print goodput, "
+                 "notifications/s and cycles/byte as CSV", cmd_curve, 1, 1);
+
+static void delay_sum_cb(struct bt_conn *conn, void *data)
+{
+	struct log2_hist *sum = data;
+	struct log2_hist hist;
+
+	stream_delay_get(conn, &hist);
+	for (size_t i = 0; i < HIST_BUCKETS; i++) {
+		sum->bucket[i] += hist.bucket[i];
+	}
+	sum->count += hist.count;
+}
+
+// Goodput and queueing delay of one window setting, delay from the
+// completions within the timed part of the measurement only
+static void window_run(const struct shell *sh, const char *mode, uint32_t arg)
+{
+	const uint32_t duration_ms = CONFIG_THROUGHPUT_SWEEP_DURATION_S *
+	                             MSEC_PER_SEC;
+	struct log2_hist before = { 0 };
+	struct log2_hist delay = { 0 };
+	struct sweep_result res;
+
+	/* Delay histograms cover the warm-up too, take it out afterwards */
+	stream_all(true);
+	k_msleep(CONFIG_THROUGHPUT_SWEEP_WARMUP_S * MSEC_PER_SEC);
+	bt_conn_foreach(BT_CONN_TYPE_LE, delay_sum_cb, &before);
+	measure_window(&res);
+	bt_conn_foreach(BT_CONN_TYPE_LE, delay_sum_cb, &delay);
+
+	for (size_t i = 0; i < HIST_BUCKETS; i++) {
+		delay.bucket[i] -= before.bucket[i];
+	}
+	delay.count -= before.count;
+
+	shell_print(sh, "%s,%u,%llu,%u,%u,%u,%u", mode, arg,
+	            res.bytes * MSEC_PER_SEC / duration_ms, delay.count,
+	            hist_percentile(&delay, 50), hist_percentile(&delay, 90),
+	            hist_percentile(&delay, 99));
+}
+
+static int cmd_windows(const struct shell *sh, size_t argc, char **argv)
+{
+	const uint32_t target = argc > 1 ? strtoul(argv[1], NULL, 0) :
+	                                   CONFIG_THROUGHPUT_WINDOW_TARGET_US;
+	struct sweep_link link = { 0 };
+	uint32_t window = 1;
+	int err;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, state_cb, &link);
+	if (!link.conn_cnt) {
+		shell_error(sh, "No connection");
+		return -ENOTCONN;
+	}
+
+	err = stream_window_set(STREAM_WINDOW_AIMD, target);
+	if (err) {
+		shell_error(sh, "Adaptive window not available (err %d)", err);
+		return err;
+	}
+
+	shell_print(sh, "mode,window_or_target_us,goodput_Bps,completions,"
+	            "p50_us,p90_us,p99_us");
+	window_run(sh, "aimd", target);
+
+	// Powers of two, then all buffers, which is also the default
+	while (true) {
+		stream_window_set(STREAM_WINDOW_FIXED, window);
+		window_run(sh, "fixed", window);
+		if (window == BULK_CREDITS) {
+			break;
+		}
+		window = MIN(window * 2, BULK_CREDITS);
+	}
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, restore_cb, NULL);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), windows, NULL,
+                 "Compare the adaptive window [target us] against fixed "
+                 "windows and print goodput and queueing delay as CSV",
+                 cmd_windows, 1, 1);
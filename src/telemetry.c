@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#include "hist.h"
+#include "service.h"
+#include "stream.h"
+#include "telemetry.h"
+#include "transport.h"
+
+#define PERIOD_MS CONFIG_THROUGHPUT_TELEMETRY_PERIOD_MS
+
+/* Characteristic value attributes, after the service declaration and
+ * each characteristic's declaration, value and CCC.
+ */
+enum telemetry_item {
+	TLM_GOODPUT,
+	TLM_ERRORS,
+	TLM_UPTIME,
+	TLM_CONN_CNT,
+	TLM_COUNT,
+};
+#define TLM_ATTR(item) (&m_tlm_svc.attrs[2 + 3 * (item)])
+
+struct telemetry {
+	struct bt_conn *conn;
+	struct k_work_delayable work;
+	uint64_t last_acked;
+	uint32_t updates;  /* Values handed to the host */
+	uint32_t pdus;     /* ATT PDUs those values went out in */
+	uint32_t batches;
+	uint32_t errors;
+};
+
+static struct telemetry m_tlm[CONFIG_BT_MAX_CONN];
+
+// Queueing delay histogram of the reading connection, one little endian
+// uint32 count per bucket
+static ssize_t read_delay(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                          void *buf, uint16_t len, uint16_t offset)
+{
+	uint8_t value[HIST_BUCKETS * sizeof(uint32_t)];
+	struct log2_hist hist;
+
+	stream_delay_get(conn, &hist);
+	for (size_t i = 0; i < HIST_BUCKETS; i++) {
+		sys_put_le32(hist.bucket[i], &value[i * sizeof(uint32_t)]);
+	}
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value,
+	                         sizeof(value));
+}
+
+static struct bt_uuid_128 tlm_uuid = BT_UUID_INIT_128(TELEMETRY_UUID_BYTES);
+
+BT_GATT_SERVICE_DEFINE(m_tlm_svc,
+    BT_GATT_PRIMARY_SERVICE(&tlm_uuid),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x1011), BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x1012), BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x1013), BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x1014), BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    /* Read on demand, too large to notify every period */
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x1015), BT_GATT_CHRC_READ,
+                           BT_GATT_PERM_READ, read_delay, NULL, NULL),
+);
+
+// Called once per ATT PDU. Batched values share the callback and user
+// data, which is what lets the host pack them into a single PDU.
+static void sent_cb(struct bt_conn *conn, void *user_data)
+{
+	m_tlm[bt_conn_index(conn)].pdus++;
+}
+
+static void count_cb(struct bt_conn *conn, void *data)
+{
+	(*(uint8_t *)data)++;
+}
+
+static void telemetry_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct telemetry *tlm = CONTAINER_OF(dwork, struct telemetry, work);
+	struct bt_gatt_notify_params params[TLM_COUNT];
+	struct stream_stats stats;
+	uint8_t goodput[4], errors[12], uptime[4];
+	uint8_t conn_cnt = 0;
+	const struct {
+		const void *data;
+		uint16_t len;
+	} value[TLM_COUNT] = {
+		[TLM_GOODPUT] = { goodput, sizeof(goodput) },
+		[TLM_ERRORS] = { errors, sizeof(errors) },
+		[TLM_UPTIME] = { uptime, sizeof(uptime) },
+		[TLM_CONN_CNT] = { &conn_cnt, sizeof(conn_cnt) },
+	};
+	uint16_t num = 0;
+	int err = 0;
+
+	if (!tlm->conn) {
+		return;
+	}
+
+	stream_stats_get(tlm->conn, &stats);
+	sys_put_le32((stats.bytes_acked - tlm->last_acked) * 1000 / PERIOD_MS,
+	             goodput);
+	tlm->last_acked = stats.bytes_acked;
+	sys_put_le32(stats.retries, &errors[0]);
+	sys_put_le32(stats.tx_wait_timeouts, &errors[4]);
+	sys_put_le32(stats.tx_drained, &errors[8]);
+	sys_put_le32(k_uptime_get_32(), uptime);
+	bt_conn_foreach(BT_CONN_TYPE_LE, count_cb, &conn_cnt);
+
+	for (size_t i = 0; i < TLM_COUNT; i++) {
+		if (!bt_gatt_is_subscribed(tlm->conn, TLM_ATTR(i),
+		                           BT_GATT_CCC_NOTIFY)) {
+			continue;
+		}
+		params[num] = (struct bt_gatt_notify_params) {
+			.attr = TLM_ATTR(i),
+			.data = value[i].data,
+			.len = value[i].len,
+			.func = sent_cb,
+		};
+		num++;
+	}
+
+#if defined(CONFIG_BT_GATT_NOTIFY_MULTIPLE)
+	if (num > 1) {
+		/* Falls back to single notifications if the central has not
+		 * enabled multiple handle value notifications.
+		 */
+		err = bt_gatt_notify_multiple(tlm->conn, num, params);
+	} else
+#endif
+	for (uint16_t i = 0; i < num && !err; i++) {
+		err = bt_gatt_notify_cb(tlm->conn, &params[i]);
+	}
+
+	if (num) {
+		if (err) {
+			tlm->errors++;
+		} else {
+			tlm->updates += num;
+			tlm->batches++;
+		}
+	}
+
+	k_work_schedule(&tlm->work, K_MSEC(PERIOD_MS));
+}
+
+void telemetry_connected(struct bt_conn *conn)
+{
+	struct telemetry *tlm = &m_tlm[bt_conn_index(conn)];
+
+	if (PERIOD_MS == 0) {
+		return;
+	}
+
+	memset(tlm, 0, sizeof(*tlm));
+	k_work_init_delayable(&tlm->work, telemetry_work_handler);
+	tlm->conn = bt_conn_ref(conn);
+	k_work_schedule(&tlm->work, K_MSEC(PERIOD_MS));
+}
+
+void telemetry_disconnected(struct bt_conn *conn)
+{
+	struct telemetry *tlm = &m_tlm[bt_conn_index(conn)];
+
+	if (tlm->conn != conn) {
+		return;
+	}
+	tlm->conn = NULL;
+	k_work_cancel_delayable(&tlm->work);
+	bt_conn_unref(conn);
+}
+
+static int cmd_telemetry(const struct shell *sh, size_t argc, char **argv)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_tlm); i++) {
+		const struct telemetry *tlm = &m_tlm[i];
+
+		shell_print(sh, "conn %u: %u updates in %u batches, %u PDUs "
+		            "(%u.%02u PDUs/update, %u saved), %u errors, "
+		            "multiple notifications %s", i, tlm->updates,
+		            tlm->batches, tlm->pdus,
+		            tlm->updates ? tlm->pdus / tlm->updates : 0,
+		            tlm->updates ?
+		            tlm->pdus * 100 / tlm->updates % 100 : 0,
+		            tlm->updates > tlm->pdus ?
+		            tlm->updates - tlm->pdus : 0,
+		            tlm->errors,
+		            tlm->conn && transport_notify_multi(tlm->conn) ?
+		            "on" : "off");
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), telemetry, NULL,
+                 "Print telemetry notification batching efficiency",
+                 cmd_telemetry, 1, 0);
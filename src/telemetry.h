@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_TELEMETRY_H_
+#define THROUGHPUT_TELEMETRY_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * @brief Start periodic telemetry notifications on a connection.
+ *
+ * @param conn New connection.
+ */
+void telemetry_connected(struct bt_conn *conn);
+
+/**
+ * @brief Stop telemetry on a connection.
+ *
+ * @param conn Connection that went away.
+ */
+void telemetry_disconnected(struct bt_conn *conn);
+
+#endif /* THROUGHPUT_TELEMETRY_H_ */
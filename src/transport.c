@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+
+#include "transport.h"
+
+/* Client Supported Features bit of multiple handle value notifications */
+#define CF_NOTIFY_MULTI BIT(2)
+
+static int bt_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                     const void *data, uint16_t len,
+                     transport_sent_cb_t sent_cb, void *user_data)
+{
+	struct bt_gatt_notify_params params = {
+		.attr = attr,
+		.data = data,
+		.len = len,
+		.func = sent_cb,
+		.user_data = user_data,
+	};
+
+	return bt_gatt_notify_cb(conn, &params);
+}
+
+static const struct transport_api bt_transport = {
+	.notify = bt_notify,
+};
+
+static const struct transport_api *m_transport = &bt_transport;
+
+void transport_set(const struct transport_api *api)
+{
+	m_transport = api ? api : &bt_transport;
+}
+
+bool transport_notify_multi(struct bt_conn *conn)
+{
+#if defined(CONFIG_BT_GATT_NOTIFY_MULTIPLE)
+	static const struct bt_gatt_attr *cf_attr;
+	uint8_t cf = 0;
+
+	// Read through the attribute, the host keeps the value per client
+	if (cf_attr == NULL) {
+		cf_attr = bt_gatt_find_by_uuid(NULL, 0,
+		                               BT_UUID_GATT_CLIENT_FEATURES);
+	}
+	if (cf_attr == NULL ||
+	    cf_attr->read(conn, cf_attr, &cf, sizeof(cf), 0) < 1) {
+		return false;
+	}
+
+	return cf & CF_NOTIFY_MULTI;
+#else
+	return false;
+#endif
+}
+
+int transport_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                     const void *data, uint16_t len,
+                     transport_sent_cb_t sent_cb, void *user_data)
+{
+	return m_transport->notify(conn, attr, data, len, sent_cb, user_data);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_TRANSPORT_H_
+#define THROUGHPUT_TRANSPORT_H_
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+/**
+ * @brief Callback invoked once a notification has left the host.
+ *
+ * @param conn      Connection the notification was sent on.
+ * @param user_data Opaque pointer passed to transport_notify().
+ */
+typedef void (*transport_sent_cb_t)(struct bt_conn *conn, void *user_data);
+
+/**
+ * @brief Notification transport backend.
+ *
+ * The send path only talks to the GATT layer through this table so that
+ * a different backend (e.g. a recording mock on native_sim) can be put in
+ * place of the Bluetooth stack.
+ */
+struct transport_api {
+	int (*notify)(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+		      const void *data, uint16_t len,
+		      transport_sent_cb_t sent_cb, void *user_data);
+};
+
+/**
+ * @brief Replace the active transport backend.
+ *
+ * @param api Backend to use, or NULL to restore the Bluetooth backend.
+ */
+void transport_set(const struct transport_api *api);
+
+/**
+ * @brief Send a single notification through the active backend.
+ *
+ * @param conn      Connection to notify.
+ * @param attr      Characteristic value attribute.
+ * @param data      Payload.
+ * @param len       Payload length, must fit in ATT_MTU - 3.
+ * @param sent_cb   Optional completion callback.
+ * @param user_data Passed to @p sent_cb.
+ *
+ * @return 0 on success or a negative errno from the backend.
+ */
+int transport_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+		     const void *data, uint16_t len,
+		     transport_sent_cb_t sent_cb, void *user_data);
+
+/**
+ * @brief Check if notifications go out as multiple handle value PDUs.
+ *
+ * With CONFIG_BT_GATT_NOTIFY_MULTIPLE the host uses that PDU format for
+ * every notification once the central has enabled it in its Client
+ * Supported Features, so each value carries NOTIFY_MULTI_OVERHEAD more
+ * header bytes.
+ *
+ * @param conn Connection.
+ *
+ * @return true if the central enabled multiple handle value notifications.
+ */
+bool transport_notify_multi(struct bt_conn *conn);
+
+#endif /* THROUGHPUT_TRANSPORT_H_ */
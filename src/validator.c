@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+
+#include "pattern.h"
+#include "validator.h"
+
+/* Index 0 is never a candidate start for an odd aligned payload */
+#define NO_INDEX UINT32_MAX
+
+static size_t mismatches(const uint8_t *data, size_t len, uint32_t idx)
+{
+	size_t cnt = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		cnt += data[i] != pattern_byte(idx + i);
+	}
+
+	return cnt;
+}
+
+// Payloads start below PATTERN_WRAP, so the 16 bits carried by one even
+// and one odd byte identify the start index exactly.
+static uint32_t recover(const uint8_t *data, size_t len)
+{
+	uint32_t idx;
+
+	if (len >= 2) {
+		idx = ((uint32_t)data[1] << 9) | ((uint32_t)data[0] << 1);
+		if (!mismatches(data, len, idx)) {
+			return idx;
+		}
+	}
+
+	if (len >= 3) {
+		idx = ((uint32_t)data[2] << 9) | ((uint32_t)data[1] << 1);
+		if (idx > 0 && !mismatches(data, len, idx - 1)) {
+			return idx - 1;
+		}
+	}
+
+	return NO_INDEX;
+}
+
+void validator_init(struct validator *v)
+{
+	memset(v, 0, sizeof(*v));
+}
+
+enum validator_result validator_feed(struct validator *v, const uint8_t *data,
+				     size_t len)
+{
+	struct validator_stats *stats = &v->stats;
+	enum validator_result result;
+	uint32_t idx, ahead;
+	size_t bad;
+
+	stats->notifications++;
+
+	/* Fast path, the stream simply continues */
+	bad = v->synced ? mismatches(data, len, v->expected) : len;
+	if (bad == 0) {
+		stats->bytes_ok += len;
+		v->expected = pattern_wrap(v->expected + len);
+		return VALIDATOR_OK;
+	}
+
+	idx = recover(data, len);
+	if (idx == NO_INDEX) {
+		if (!v->synced) {
+			/* Nothing to compare against yet */
+			stats->bytes_corrupt += len;
+			stats->corrupt++;
+			return VALIDATOR_CORRUPT;
+		}
+		/* Assume it is the expected payload with bytes damaged */
+		stats->bytes_corrupt += bad;
+		stats->bytes_ok += len - bad;
+		stats->corrupt++;
+		v->expected = pattern_wrap(v->expected + len);
+		return VALIDATOR_CORRUPT;
+	}
+
+	if (!v->synced) {
+		result = VALIDATOR_SYNCED;
+	} else {
+		/* Distance in the wrapped index space, half of it each way */
+		ahead = (idx + PATTERN_WRAP - v->expected) % PATTERN_WRAP;
+		if (ahead < PATTERN_WRAP / 2) {
+			stats->bytes_lost += ahead;
+			stats->gaps++;
+			result = VALIDATOR_GAP;
+		} else {
+			/* Already counted when it first arrived, and the
+			 * stream still continues where it left off
+			 */
+			stats->bytes_duplicate += len;
+			stats->duplicates++;
+			return VALIDATOR_DUPLICATE;
+		}
+	}
+
+	stats->resyncs++;
+	stats->bytes_ok += len;
+	v->synced = true;
+	v->expected = pattern_wrap(idx + len);
+
+	return result;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_VALIDATOR_H_
+#define THROUGHPUT_VALIDATOR_H_
+
+/* Plain C, shared by the device and host builds */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Outcome of validating one notification. */
+enum validator_result {
+	VALIDATOR_OK,        /* Continues the stream */
+	VALIDATOR_SYNCED,    /* First notification, or resynchronized */
+	VALIDATOR_GAP,       /* Valid, but bytes before it were lost */
+	VALIDATOR_DUPLICATE, /* Valid, but repeats bytes already seen */
+	VALIDATOR_CORRUPT,   /* Does not match the pattern anywhere */
+};
+
+/** @brief Receiver statistics, in pattern bytes. */
+struct validator_stats {
+	uint32_t notifications;
+	uint64_t bytes_ok;
+	uint64_t bytes_lost;
+	uint64_t bytes_duplicate;
+	uint64_t bytes_corrupt;  /* Bytes that differ from the expected ones */
+	uint32_t gaps;
+	uint32_t duplicates;
+	uint32_t corrupt;        /* Notifications with corrupt bytes */
+	uint32_t resyncs;
+};
+
+/** @brief Validator state of one stream. */
+struct validator {
+	uint32_t expected;  /* Pattern index the next notification starts at */
+	bool synced;
+	struct validator_stats stats;
+};
+
+/**
+ * @brief Reset a validator. The next notification synchronizes it.
+ *
+ * @param v Validator.
+ */
+void validator_init(struct validator *v);
+
+/**
+ * @brief Validate a notification carrying one whole payload.
+ *
+ * The pattern index of the notification is recovered from its first
+ * bytes, so loss and duplication are measured at byte granularity and
+ * the validator resynchronizes on the first intact notification after a
+ * gap. A notification that matches no index is compared byte by byte
+ * against the expected one.
+ *
+ * @param v    Validator.
+ * @param data Notification payload.
+ * @param len  Payload length.
+ *
+ * @return How the notification relates to the stream so far.
+ */
+enum validator_result validator_feed(struct validator *v, const uint8_t *data,
+				     size_t len);
+
+#endif /* THROUGHPUT_VALIDATOR_H_ */
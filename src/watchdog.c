@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+#include "link_proc.h"
+#include "stream.h"
+#include "watchdog.h"
+
+#define WINDOW_MS CONFIG_THROUGHPUT_STALL_WINDOW_MS
+#define LOG_SIZE  CONFIG_THROUGHPUT_STALL_LOG_SIZE
+
+struct stall_wd {
+	struct bt_conn *conn;
+	struct k_work_delayable work;
+	uint64_t last_acked;
+	int64_t last_progress;
+	enum stall_action level;
+	/* Stall still being recovered on this connection */
+	struct stall_record *open;
+};
+
+static struct stall_wd m_wd[CONFIG_BT_MAX_CONN];
+static struct stall_record m_log[LOG_SIZE];
+static uint32_t m_log_cnt;
+
+static const char *action2str(enum stall_action action)
+{
+	switch (action) {
+	case STALL_ACTION_NONE: return "none";
+	case STALL_ACTION_LINK_UPDATE: return "phy/data len";
+	case STALL_ACTION_CONN_PARAM: return "conn param";
+	case STALL_ACTION_DISCONNECT: return "disconnect";
+	default: return "unknown";
+	}
+}
+
+// Oldest record is reused, so no watchdog may keep it open
+static struct stall_record *log_alloc(void)
+{
+	struct stall_record *rec = &m_log[m_log_cnt++ % LOG_SIZE];
+
+	for (size_t i = 0; i < ARRAY_SIZE(m_wd); i++) {
+		if (m_wd[i].open == rec) {
+			m_wd[i].open = NULL;
+		}
+	}
+	memset(rec, 0, sizeof(*rec));
+
+	return rec;
+}
+
+static void escalate(struct bt_conn *conn, enum stall_action action)
+{
+	static const struct bt_conn_le_phy_param phy = {
+		.options = BT_CONN_LE_PHY_OPT_NONE,
+		.pref_rx_phy = BT_GAP_LE_PHY_2M,
+		.pref_tx_phy = BT_GAP_LE_PHY_2M,
+	};
+	struct bt_conn_info info;
+	int err = 0;
+
+	printk("Stream stalled, recovery step: %s\n", action2str(action));
+
+	switch (action) {
+	case STALL_ACTION_LINK_UPDATE:
+		link_proc_phy(conn, &phy);
+		link_proc_data_len(conn, BT_LE_DATA_LEN_PARAM_MAX);
+		break;
+	case STALL_ACTION_CONN_PARAM:
+		err = bt_conn_get_info(conn, &info);
+		if (err) {
+			printk("Failed to get connection info (%d)\n", err);
+			break;
+		}
+		/* Same interval, but forces a fresh update procedure */
+		link_proc_conn_param(conn,
+			BT_LE_CONN_PARAM(info.le.interval, info.le.interval,
+			                 info.le.latency, info.le.timeout));
+		break;
+	case STALL_ACTION_DISCONNECT:
+		err = bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+		if (err) {
+			printk("bt_conn_disconnect() returned %d\n", err);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void wd_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct stall_wd *wd = CONTAINER_OF(dwork, struct stall_wd, work);
+	struct stream_stats stats;
+	const int64_t now = k_uptime_get();
+
+	if (wd->conn == NULL) {
+		return;
+	}
+
+	stream_stats_get(wd->conn, &stats);
+	const bool progress = stats.bytes_acked != wd->last_acked;
+	const bool outstanding = stream_in_flight(wd->conn) > 0;
+
+	if (progress || !outstanding) {
+		if (progress && wd->open) {
+			wd->open->recovered = now;
+			printk("Stream recovered after %lld ms (%s)\n",
+			       now - wd->open->last_progress,
+			       action2str(wd->open->action));
+			wd->open = NULL;
+		}
+		wd->last_acked = stats.bytes_acked;
+		wd->last_progress = now;
+		wd->level = STALL_ACTION_NONE;
+	} else if (wd->level < STALL_ACTION_DISCONNECT) {
+		if (wd->open == NULL) {
+			wd->open = log_alloc();
+			wd->open->last_progress = wd->last_progress;
+			wd->open->detected = now;
+		}
+		wd->level++;
+		wd->open->action = MAX(wd->open->action, wd->level);
+		escalate(wd->conn, wd->level);
+	}
+
+	k_work_reschedule(&wd->work, K_MSEC(WINDOW_MS));
+}
+
+void watchdog_start(struct bt_conn *conn)
+{
+	struct stall_wd *wd = &m_wd[bt_conn_index(conn)];
+
+	if (WINDOW_MS == 0 || wd->conn) {
+		return;
+	}
+
+	k_work_init_delayable(&wd->work, wd_work_handler);
+	wd->conn = bt_conn_ref(conn);
+	wd->last_acked = 0;
+	wd->last_progress = k_uptime_get();
+	wd->level = STALL_ACTION_NONE;
+	wd->open = NULL;
+	k_work_reschedule(&wd->work, K_MSEC(WINDOW_MS));
+}
+
+void watchdog_stop(struct bt_conn *conn)
+{
+	struct stall_wd *wd = &m_wd[bt_conn_index(conn)];
+
+	if (wd->conn != conn) {
+		return;
+	}
+
+	k_work_cancel_delayable(&wd->work);
+	/* The next connection in this slot may be another central, so its
+	 * progress says nothing about this stall
+	 */
+	if (wd->open) {
+		wd->open->disconnected = k_uptime_get();
+		wd->open = NULL;
+	}
+	bt_conn_unref(wd->conn);
+	wd->conn = NULL;
+}
+
+static int cmd_recovery(const struct shell *sh, size_t argc, char **argv)
+{
+	const uint32_t cnt = MIN(m_log_cnt, LOG_SIZE);
+	int64_t total_ms = 0;
+	uint32_t recovered = 0;
+	uint32_t disconnected = 0;
+
+	shell_print(sh, "stalls: %u", m_log_cnt);
+	for (uint32_t i = 0; i < cnt; i++) {
+		const struct stall_record *rec = &m_log[i];
+
+		if (rec->recovered) {
+			total_ms += rec->recovered - rec->last_progress;
+			recovered++;
+		} else if (rec->disconnected) {
+			disconnected++;
+		}
+		shell_print(sh, "%u: last progress %lld detected %lld "
+		            "recovered %lld disconnected %lld step %s", i,
+		            rec->last_progress, rec->detected, rec->recovered,
+		            rec->disconnected, action2str(rec->action));
+	}
+	if (disconnected) {
+		shell_print(sh, "ended by disconnect: %u", disconnected);
+	}
+	if (recovered) {
+		shell_print(sh, "mean time to recover: %lld ms",
+		            total_ms / recovered);
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((throughput), recovery, NULL,
+                 "Print stall watchdog recovery log", cmd_recovery, 1, 0);
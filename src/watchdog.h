@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef THROUGHPUT_WATCHDOG_H_
+#define THROUGHPUT_WATCHDOG_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/** @brief Recovery steps, in escalation order. */
+enum stall_action {
+	STALL_ACTION_NONE = 0,
+	STALL_ACTION_LINK_UPDATE,  /* Re-request PHY and data length */
+	STALL_ACTION_CONN_PARAM,   /* Renegotiate connection parameters */
+	STALL_ACTION_DISCONNECT,   /* Drop the link and re-advertise */
+};
+
+/** @brief One stall and its recovery, timestamps in ms of uptime. */
+struct stall_record {
+	int64_t last_progress;
+	int64_t detected;
+	int64_t recovered;      /* 0 while the stall is still open */
+	int64_t disconnected;   /* Link lost before it recovered, or 0 */
+	enum stall_action action; /* Highest step that was needed */
+};
+
+/**
+ * @brief Start watching a connection for stalled notification progress.
+ *
+ * @param conn Connection that streams notifications.
+ */
+void watchdog_start(struct bt_conn *conn);
+
+/**
+ * @brief Stop watching a connection.
+ *
+ * A stall still open on the connection ends as disconnected.
+ *
+ * @param conn Connection passed to watchdog_start().
+ */
+void watchdog_stop(struct bt_conn *conn);
+
+#endif /* THROUGHPUT_WATCHDOG_H_ */
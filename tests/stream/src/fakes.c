@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/ztest.h>
+
+#include "boot.h"
+#include "fakes.h"
+#include "load.h"
+#include "matrix.h"
+
+/* Stand-ins for the connection objects of the Bluetooth host */
+static uint8_t m_conns[CONFIG_BT_MAX_CONN];
+
+struct bt_conn *fake_conn(uint8_t idx)
+{
+	return (struct bt_conn *)&m_conns[idx];
+}
+
+uint8_t bt_conn_index(const struct bt_conn *conn)
+{
+	return (const uint8_t *)conn - m_conns;
+}
+
+// Every notification has to go through the transport under test
+int bt_gatt_notify_cb(struct bt_conn *conn,
+                      struct bt_gatt_notify_params *params)
+{
+	ztest_test_fail();
+
+	return -EIO;
+}
+
+void boot_mark(enum boot_event event)
+{
+}
+
+void matrix_record(struct bt_conn *conn, uint16_t len, uint32_t latency_us)
+{
+}
+
+void load_record(uint16_t len, uint32_t latency_us)
+{
+}
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef FAKES_H_
+#define FAKES_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * @brief Connection object understood by the faked bt_conn_index().
+ *
+ * @param idx Connection index, below CONFIG_BT_MAX_CONN.
+ *
+ * @return Opaque connection pointer.
+ */
+struct bt_conn *fake_conn(uint8_t idx);
+
+#endif /* FAKES_H_ */
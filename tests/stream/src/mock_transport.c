@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <string.h>
+
+#include "mock_transport.h"
+
+static struct mock_call m_calls[MOCK_CALLS_MAX];
+static size_t m_call_cnt;
+static size_t m_attempts;
+static size_t m_next_pending;
+
+static int m_fail_err;
+static uint32_t m_fail_skip;
+static uint32_t m_fail_cnt;
+static bool m_inline;
+static bool m_record = true;
+static uint32_t m_delay_ms;
+
+static void complete_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_complete_work, complete_work_handler);
+
+static void complete(struct mock_call *call)
+{
+	call->completed = true;
+	if (call->sent_cb) {
+		call->sent_cb(call->conn, call->user_data);
+	}
+}
+
+// Completions are in order, as the controller reports them
+static void complete_work_handler(struct k_work *work)
+{
+	const int64_t now = k_uptime_get();
+
+	while (m_next_pending < m_call_cnt) {
+		struct mock_call *call = &m_calls[m_next_pending];
+
+		if (call->completed) {
+			m_next_pending++;
+			continue;
+		}
+		if (call->due_ms > now) {
+			k_work_schedule(&m_complete_work,
+			                K_MSEC(call->due_ms - now));
+			return;
+		}
+		m_next_pending++;
+		complete(call);
+	}
+}
+
+static int mock_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                       const void *data, uint16_t len,
+                       transport_sent_cb_t sent_cb, void *user_data)
+{
+	struct mock_call *call;
+
+	m_attempts++;
+
+	if (m_fail_skip) {
+		m_fail_skip--;
+	} else if (m_fail_cnt) {
+		m_fail_cnt--;
+		return m_fail_err;
+	}
+
+	if (!m_record && m_inline) {
+		if (sent_cb) {
+			sent_cb(conn, user_data);
+		}
+		return 0;
+	}
+
+	if (m_call_cnt == ARRAY_SIZE(m_calls)) {
+		/* Like the host running out of buffers */
+		return -ENOMEM;
+	}
+
+	call = &m_calls[m_call_cnt++];
+	call->conn = conn;
+	call->len = len;
+	memcpy(call->data, data, MIN(len, sizeof(call->data)));
+	call->sent_cb = sent_cb;
+	call->user_data = user_data;
+	call->due_ms = k_uptime_get() + m_delay_ms;
+	call->completed = false;
+
+	if (m_inline) {
+		complete(call);
+	} else if (m_delay_ms) {
+		k_work_schedule(&m_complete_work, K_MSEC(m_delay_ms));
+	}
+
+	return 0;
+}
+
+static const struct transport_api mock_transport = {
+	.notify = mock_notify,
+};
+
+void mock_transport_reset(void)
+{
+	struct k_work_sync sync;
+
+	k_work_cancel_delayable_sync(&m_complete_work, &sync);
+	m_call_cnt = 0;
+	m_attempts = 0;
+	m_next_pending = 0;
+	m_fail_err = 0;
+	m_fail_skip = 0;
+	m_fail_cnt = 0;
+	m_inline = false;
+	m_record = true;
+	m_delay_ms = 0;
+	transport_set(&mock_transport);
+}
+
+void mock_transport_fail(int err, uint32_t skip, uint32_t count)
+{
+	m_fail_err = err;
+	m_fail_skip = skip;
+	m_fail_cnt = count;
+}
+
+void mock_transport_complete_inline(bool enable)
+{
+	m_inline = enable;
+}
+
+void mock_transport_complete_after(uint32_t delay_ms)
+{
+	m_delay_ms = delay_ms;
+}
+
+void mock_transport_record(bool enable)
+{
+	m_record = enable;
+}
+
+size_t mock_transport_complete(size_t n)
+{
+	size_t done = 0;
+
+	while (done < n && m_next_pending < m_call_cnt) {
+		struct mock_call *call = &m_calls[m_next_pending++];
+
+		if (!call->completed) {
+			complete(call);
+			done++;
+		}
+	}
+
+	return done;
+}
+
+size_t mock_transport_calls(void)
+{
+	return m_call_cnt;
+}
+
+size_t mock_transport_attempts(void)
+{
+	return m_attempts;
+}
+
+const struct mock_call *mock_transport_call(size_t idx)
+{
+	return &m_calls[idx];
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MOCK_TRANSPORT_H_
+#define MOCK_TRANSPORT_H_
+
+#include <zephyr/kernel.h>
+
+#include "transport.h"
+
+#define MOCK_CALLS_MAX 32
+#define MOCK_DATA_MAX  (CONFIG_BT_L2CAP_TX_MTU - 3)
+
+/** @brief Notification accepted by the mock backend. */
+struct mock_call {
+	struct bt_conn *conn;
+	uint16_t len;
+	uint8_t data[MOCK_DATA_MAX];
+	transport_sent_cb_t sent_cb;
+	void *user_data;
+	int64_t due_ms;  /* Completion time with a completion delay */
+	bool completed;
+};
+
+/**
+ * @brief Install the mock backend and forget all calls and settings.
+ *
+ * Pending completions are dropped without calling them.
+ */
+void mock_transport_reset(void);
+
+/**
+ * @brief Fail notify calls.
+ *
+ * @param err   Error to return.
+ * @param skip  Calls to accept before failing.
+ * @param count Calls to fail after that.
+ */
+void mock_transport_fail(int err, uint32_t skip, uint32_t count);
+
+/**
+ * @brief Call the completion callback before notify returns.
+ *
+ * @param enable true to complete inline.
+ */
+void mock_transport_complete_inline(bool enable);
+
+/**
+ * @brief Complete every accepted notification after a delay.
+ *
+ * Completions run from the system work queue, like the Bluetooth host
+ * running them when the controller reports the packets sent.
+ *
+ * @param delay_ms Delay after the notify call, 0 to complete only from
+ *                 mock_transport_complete().
+ */
+void mock_transport_complete_after(uint32_t delay_ms);
+
+/**
+ * @brief Keep copies of the accepted payloads.
+ *
+ * On by default. With recording off and inline completion the backend
+ * accepts any number of calls, for benchmarks.
+ *
+ * @param enable true to record.
+ */
+void mock_transport_record(bool enable);
+
+/**
+ * @brief Complete the oldest pending notifications.
+ *
+ * @param n Largest number to complete.
+ *
+ * @return Number completed.
+ */
+size_t mock_transport_complete(size_t n);
+
+/** @brief Number of recorded notifications. */
+size_t mock_transport_calls(void);
+
+/** @brief Number of notify calls, accepted or failed. */
+size_t mock_transport_attempts(void);
+
+/**
+ * @brief Get a recorded notification.
+ *
+ * @param idx Index in call order.
+ *
+ * @return Call record.
+ */
+const struct mock_call *mock_transport_call(size_t idx);
+
+#endif /* MOCK_TRANSPORT_H_ */
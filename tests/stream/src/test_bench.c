@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "fakes.h"
+#include "mock_transport.h"
+#include "payload.h"
+#include "stream.h"
+
+/* Largest notification of the application's default configuration */
+#define BENCH_MTU    247
+#define BENCH_LEN    (BENCH_MTU - MTU_OVERHEAD)
+#define BENCH_ROUNDS 20000
+
+BUILD_ASSERT(BENCH_LEN <= PAYLOAD_MAX);
+
+// Host TSC, simulated time does not advance while code runs on native_sim
+static inline uint64_t host_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void print_rate(const char *what, uint64_t cycles, uint64_t bytes)
+{
+	const uint64_t centi = cycles * 100 / bytes;
+
+	TC_PRINT("%s: %u.%02u cycles/byte\n", what, (uint32_t)(centi / 100),
+	         (uint32_t)(centi % 100));
+}
+
+ZTEST_SUITE(stream_bench, NULL, NULL, NULL, NULL, NULL);
+
+// Producer and send path per byte with a backend that completes at once,
+// so only the application's own work is measured
+ZTEST(stream_bench, test_cycles_per_byte)
+{
+	static uint8_t buf[BENCH_LEN];
+	struct bt_conn *conn = fake_conn(0);
+	uint64_t fill = 0;
+	uint64_t send = 0;
+	uint32_t idx = 0;
+
+	if (host_cycles() == 0) {
+		ztest_test_skip();
+	}
+
+	mock_transport_reset();
+	mock_transport_complete_inline(true);
+	mock_transport_record(false);
+	zassert_ok(stream_window_set(STREAM_WINDOW_FIXED, BULK_CREDITS));
+	stream_reset(conn);
+
+	for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+		uint16_t offset = 0;
+		uint64_t start = host_cycles();
+
+		payload_fill(buf, sizeof(buf), &idx);
+		fill += host_cycles() - start;
+
+		start = host_cycles();
+		zassert_ok(stream_send(conn, NULL, buf, sizeof(buf), BENCH_MTU,
+		                       &offset));
+		send += host_cycles() - start;
+	}
+
+	stream_disconnected(conn);
+	transport_set(NULL);
+
+	TC_PRINT("%u notifications of %u bytes, instrumentation %s\n",
+	         BENCH_ROUNDS, BENCH_LEN,
+	         IS_ENABLED(CONFIG_THROUGHPUT_INSTRUMENT) ? "on" : "off");
+	print_rate("payload_fill", fill, (uint64_t)BENCH_ROUNDS * BENCH_LEN);
+	print_rate("stream_send", send, (uint64_t)BENCH_ROUNDS * BENCH_LEN);
+}
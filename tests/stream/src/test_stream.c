@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <string.h>
+
+#include "fakes.h"
+#include "mock_transport.h"
+#include "stream.h"
+
+/* Smallest ATT MTU, one notification carries 20 bytes */
+#define MTU  23
+#define FRAG (MTU - MTU_OVERHEAD)
+
+static struct bt_conn *m_conn;
+static uint8_t m_src[(BULK_CREDITS + 1) * FRAG];
+
+// Notified fragments must have the given lengths and carry m_src in order
+static void check_calls(const uint16_t *lens, size_t cnt)
+{
+	size_t pos = 0;
+
+	zassert_equal(mock_transport_calls(), cnt, "%zu notifications",
+	              mock_transport_calls());
+	for (size_t i = 0; i < cnt; i++) {
+		const struct mock_call *call = mock_transport_call(i);
+
+		zassert_equal(call->conn, m_conn);
+		zassert_equal(call->len, lens[i], "fragment %zu: %u bytes", i,
+		              call->len);
+		zassert_mem_equal(call->data, &m_src[pos], call->len,
+		                  "fragment %zu", i);
+		pos += call->len;
+	}
+}
+
+static struct stream_stats stats_get(void)
+{
+	struct stream_stats stats;
+
+	stream_stats_get(m_conn, &stats);
+
+	return stats;
+}
+
+static void *stream_setup(void)
+{
+	m_conn = fake_conn(0);
+	for (size_t i = 0; i < sizeof(m_src); i++) {
+		m_src[i] = i;
+	}
+
+	return NULL;
+}
+
+static void stream_before(void *fixture)
+{
+	mock_transport_reset();
+	zassert_ok(stream_window_set(STREAM_WINDOW_FIXED, BULK_CREDITS));
+	stream_reset(m_conn);
+	/* Completions given by the previous test */
+	while (stream_tx_wait(K_NO_WAIT) == 0) {
+	}
+}
+
+static void stream_after(void *fixture)
+{
+	stream_disconnected(m_conn);
+	mock_transport_reset();
+	transport_set(NULL);
+}
+
+ZTEST_SUITE(stream, NULL, stream_setup, stream_before, stream_after, NULL);
+
+ZTEST(stream, test_fragment_mtu_minus_3)
+{
+	static const uint16_t lens[] = { FRAG };
+	uint16_t offset = 0;
+
+	zassert_ok(stream_send(m_conn, NULL, m_src, MTU - 3, MTU, &offset));
+	zassert_equal(offset, MTU - 3);
+	check_calls(lens, ARRAY_SIZE(lens));
+}
+
+ZTEST(stream, test_fragment_mtu_minus_2)
+{
+	static const uint16_t lens[] = { FRAG, 1 };
+	uint16_t offset = 0;
+
+	zassert_ok(stream_send(m_conn, NULL, m_src, MTU - 2, MTU, &offset));
+	zassert_equal(offset, MTU - 2);
+	check_calls(lens, ARRAY_SIZE(lens));
+}
+
+ZTEST(stream, test_fragment_two_mtu_plus_1)
+{
+	static const uint16_t lens[] = { FRAG, FRAG, 2 * MTU + 1 - 2 * FRAG };
+	uint16_t offset = 0;
+
+	zassert_ok(stream_send(m_conn, NULL, m_src, 2 * MTU + 1, MTU,
+	                       &offset));
+	zassert_equal(offset, 2 * MTU + 1);
+	check_calls(lens, ARRAY_SIZE(lens));
+	zassert_equal(stats_get().bytes_sent, 2 * MTU + 1);
+	zassert_equal(stats_get().notifications, ARRAY_SIZE(lens));
+}
+
+ZTEST(stream, test_no_conn)
+{
+	uint16_t offset = 0;
+
+	zassert_equal(stream_send(NULL, NULL, m_src, FRAG, MTU, &offset),
+	              -ENODEV);
+	zassert_equal(mock_transport_attempts(), 0);
+}
+
+ZTEST(stream, test_notconn_propagates)
+{
+	const uint32_t errors = stream_errors_total();
+	uint16_t offset = 0;
+
+	mock_transport_fail(-ENOTCONN, 0, 1);
+	zassert_equal(stream_send(m_conn, NULL, m_src, 2 * FRAG, MTU, &offset),
+	              -ENOTCONN);
+	zassert_equal(offset, 0);
+	zassert_equal(stats_get().err_notconn, 1);
+	zassert_equal(stats_get().last_err, -ENOTCONN);
+	zassert_equal(stream_errors_total(), errors + 1);
+
+	/* The slot reserved for the failed notification was given back */
+	zassert_ok(stream_send(m_conn, NULL, m_src, BULK_CREDITS * FRAG, MTU,
+	                       &offset));
+	zassert_equal(mock_transport_calls(), BULK_CREDITS);
+}
+
+ZTEST(stream, test_error_mid_buffer_resumes)
+{
+	static const uint16_t lens[] = { FRAG, FRAG, 2 * MTU + 1 - 2 * FRAG };
+	uint16_t offset = 0;
+
+	mock_transport_fail(-EIO, 1, 1);
+	zassert_equal(stream_send(m_conn, NULL, m_src, 2 * MTU + 1, MTU,
+	                          &offset), -EIO);
+	zassert_equal(offset, FRAG);
+	zassert_equal(stats_get().err_other, 1);
+
+	zassert_ok(stream_send(m_conn, NULL, m_src, 2 * MTU + 1, MTU,
+	                       &offset));
+	zassert_equal(offset, 2 * MTU + 1);
+	check_calls(lens, ARRAY_SIZE(lens));
+}
+
+ZTEST(stream, test_nomem_waits_for_completion)
+{
+	static const uint16_t lens[] = { FRAG, FRAG };
+	uint16_t offset = 0;
+
+	/* The first notification completes while the second is refused */
+	mock_transport_complete_after(5);
+	mock_transport_fail(-ENOMEM, 1, 1);
+	zassert_ok(stream_send(m_conn, NULL, m_src, 2 * FRAG, MTU, &offset));
+	check_calls(lens, ARRAY_SIZE(lens));
+	zassert_equal(stats_get().err_nomem, 1);
+	zassert_equal(stats_get().retries, 1);
+	zassert_equal(stats_get().window_waits, 0);
+	zassert_equal(stats_get().tx_wait_timeouts, 0);
+}
+
+ZTEST(stream, test_nomem_times_out)
+{
+	uint16_t offset = 0;
+
+	mock_transport_fail(-ENOMEM, 0, 1);
+	zassert_equal(stream_send(m_conn, NULL, m_src, FRAG, MTU, &offset),
+	              -EAGAIN);
+	zassert_equal(offset, 0);
+	zassert_equal(stats_get().tx_wait_timeouts, 1);
+	zassert_equal(mock_transport_calls(), 0);
+
+	zassert_ok(stream_send(m_conn, NULL, m_src, FRAG, MTU, &offset));
+	zassert_equal(mock_transport_calls(), 1);
+}
+
+ZTEST(stream, test_credit_limit)
+{
+	const uint16_t len = (BULK_CREDITS + 1) * FRAG;
+	uint16_t offset = 0;
+
+	zassert_equal(stream_send(m_conn, NULL, m_src, len, MTU, &offset),
+	              -EAGAIN);
+	zassert_equal(offset, BULK_CREDITS * FRAG);
+	/* The host is not asked for more buffers than bulk data owns */
+	zassert_equal(mock_transport_attempts(), BULK_CREDITS);
+	zassert_equal(stream_in_flight(m_conn), BULK_CREDITS);
+	zassert_equal(stats_get().window_waits, 1);
+	zassert_equal(stats_get().err_nomem, 0);
+	zassert_equal(stats_get().retries, 0);
+	zassert_equal(stats_get().last_err, 0);
+
+	zassert_equal(mock_transport_complete(1), 1);
+	zassert_ok(stream_send(m_conn, NULL, m_src, len, MTU, &offset));
+	zassert_equal(mock_transport_calls(), BULK_CREDITS + 1);
+}
+
+ZTEST(stream, test_inline_completion)
+{
+	static const uint16_t lens[] = { FRAG, FRAG, 2 * MTU + 1 - 2 * FRAG };
+	uint16_t offset = 0;
+
+	mock_transport_complete_inline(true);
+	zassert_ok(stream_send(m_conn, NULL, m_src, 2 * MTU + 1, MTU,
+	                       &offset));
+	check_calls(lens, ARRAY_SIZE(lens));
+	zassert_equal(stats_get().bytes_acked, 2 * MTU + 1);
+	zassert_equal(stats_get().tx_drained, ARRAY_SIZE(lens));
+
+	/* Completing before notify returned left no slot taken */
+	mock_transport_complete_inline(false);
+	offset = 0;
+	zassert_ok(stream_send(m_conn, NULL, m_src, BULK_CREDITS * FRAG, MTU,
+	                       &offset));
+}
+
+ZTEST(stream, test_disconnect_returns_credits)
+{
+	const uint64_t acked = stream_bytes_acked_total();
+	uint16_t offset = 0;
+
+	zassert_ok(stream_send(m_conn, NULL, m_src, BULK_CREDITS * FRAG, MTU,
+	                       &offset));
+	stream_disconnected(m_conn);
+
+	/* Completions of the old link arrive late and are ignored */
+	zassert_equal(mock_transport_complete(BULK_CREDITS), BULK_CREDITS);
+	zassert_equal(stats_get().bytes_acked, 0);
+	zassert_equal(stream_bytes_acked_total(), acked);
+	zassert_equal(stream_in_flight(m_conn), 0);
+
+	/* All credits are available to the next link */
+	stream_reset(m_conn);
+	offset = 0;
+	zassert_ok(stream_send(m_conn, NULL, m_src, BULK_CREDITS * FRAG, MTU,
+	                       &offset));
+	zassert_equal(mock_transport_calls(), 2 * BULK_CREDITS);
+}
+
+ZTEST(stream, test_mtu_change_mid_stream)
+{
+	static const uint16_t lens[] = { FRAG, 2 * MTU + 1 - FRAG };
+	const uint16_t mtu = 2 * MTU + 1 - FRAG + MTU_OVERHEAD;
+	uint16_t offset = 0;
+
+	/* Blocked after the first fragment, then resumed after the MTU
+	 * exchange completed
+	 */
+	mock_transport_fail(-ENOMEM, 1, 1);
+	zassert_equal(stream_send(m_conn, NULL, m_src, 2 * MTU + 1, MTU,
+	                          &offset), -EAGAIN);
+	zassert_equal(offset, FRAG);
+
+	zassert_ok(stream_send(m_conn, NULL, m_src, 2 * MTU + 1, mtu,
+	                       &offset));
+	zassert_equal(offset, 2 * MTU + 1);
+	check_calls(lens, ARRAY_SIZE(lens));
+}
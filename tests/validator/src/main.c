@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/ztest.h>
+
+#include "pattern.h"
+#include "validator.h"
+
+#define LEN 20
+
+static struct validator m_v;
+static uint8_t m_buf[LEN];
+
+// Payload of the pattern starting at idx, as the sender fills it
+static const uint8_t *payload(uint32_t idx)
+{
+	for (size_t i = 0; i < sizeof(m_buf); i++) {
+		m_buf[i] = pattern_byte(idx + i);
+	}
+
+	return m_buf;
+}
+
+static enum validator_result feed(uint32_t idx)
+{
+	return validator_feed(&m_v, payload(idx), LEN);
+}
+
+static void validator_before(void *fixture)
+{
+	validator_init(&m_v);
+}
+
+ZTEST_SUITE(validator, NULL, NULL, validator_before, NULL, NULL);
+
+ZTEST(validator, test_in_order)
+{
+	zassert_equal(feed(0), VALIDATOR_SYNCED);
+	zassert_equal(feed(LEN), VALIDATOR_OK);
+	zassert_equal(feed(2 * LEN), VALIDATOR_OK);
+	zassert_equal(m_v.stats.bytes_ok, 3 * LEN);
+	zassert_equal(m_v.stats.bytes_lost, 0);
+}
+
+ZTEST(validator, test_gap)
+{
+	zassert_equal(feed(0), VALIDATOR_SYNCED);
+	zassert_equal(feed(3 * LEN), VALIDATOR_GAP);
+	zassert_equal(feed(4 * LEN), VALIDATOR_OK);
+	zassert_equal(m_v.stats.bytes_lost, 2 * LEN);
+	zassert_equal(m_v.stats.gaps, 1);
+}
+
+ZTEST(validator, test_duplicate_then_in_order)
+{
+	zassert_equal(feed(0), VALIDATOR_SYNCED);
+	zassert_equal(feed(LEN), VALIDATOR_OK);
+	zassert_equal(feed(0), VALIDATOR_DUPLICATE);
+	zassert_equal(feed(2 * LEN), VALIDATOR_OK);
+	zassert_equal(m_v.stats.bytes_lost, 0);
+	zassert_equal(m_v.stats.bytes_ok, 3 * LEN);
+	zassert_equal(m_v.stats.bytes_duplicate, LEN);
+	zassert_equal(m_v.stats.duplicates, 1);
+	zassert_equal(m_v.stats.resyncs, 1);
+}
+
+ZTEST(validator, test_corrupt_keeps_position)
+{
+	zassert_equal(feed(0), VALIDATOR_SYNCED);
+	payload(LEN);
+	m_buf[5] ^= 0xff;
+	zassert_equal(validator_feed(&m_v, m_buf, LEN), VALIDATOR_CORRUPT);
+	zassert_equal(m_v.stats.bytes_corrupt, 1);
+	zassert_equal(feed(2 * LEN), VALIDATOR_OK);
+	zassert_equal(m_v.stats.bytes_lost, 0);
+}
+
+ZTEST(validator, test_wrap)
+{
+	const uint32_t last = PATTERN_WRAP - LEN / 2;
+	const uint32_t next = pattern_wrap(last + LEN);
+
+	zassert_true(next < last);
+	zassert_equal(feed(last), VALIDATOR_SYNCED);
+	zassert_equal(feed(next), VALIDATOR_OK);
+	zassert_equal(m_v.stats.bytes_lost, 0);
+}